@@ -0,0 +1,200 @@
+#!/usr/bin/env node
+
+// Long-lived compiler used by colony on PC, so that requiring a tree of
+// modules costs one Node boot instead of one per file. Requests are read as
+// lines from stdin and responses are written to stdout, which starts with a
+// "ready" line once the compiler has loaded:
+//
+//   deps <file>                  -> <count>\n<file>\n...
+//     The .js files reachable from <file> through static require() calls,
+//     including <file> itself.
+//
+//   compile <jit|lua> <count>\n<file>\n...
+//                                -> (ok|error) <length>\n<bytes>, per file
+//     Compiled module for each file, as LuaJIT source or Lua bytecode, or
+//     the error message for files that fail to compile.
+//
+// Run as `colony-compiler-server.js <jit|lua> <file>`, it compiles the one
+// file to stdout and exits instead. colony uses that for single modules, so
+// everything in its cache comes from the compile() below.
+
+var fs = require('fs');
+var path = require('path');
+var colonyCompiler = require('colony-compiler');
+
+var REQUIRE_RE = /\brequire\s*\(\s*(['"])([^'"]+)\1\s*\)/g;
+
+function isFile (p) {
+  try {
+    return fs.statSync(p).isFile();
+  } catch (e) {
+    return false;
+  }
+}
+
+function resolveFile (p) {
+  if (isFile(p)) {
+    return p;
+  }
+  if (isFile(p + '.js')) {
+    return p + '.js';
+  }
+  if (isFile(p + '.json')) {
+    return p + '.json';
+  }
+  var pkgjson = path.join(p, 'package.json');
+  if (isFile(pkgjson)) {
+    try {
+      var main = JSON.parse(fs.readFileSync(pkgjson, 'utf-8')).main;
+      if (main) {
+        var resolved = resolveFile(path.join(p, main));
+        if (resolved) {
+          return resolved;
+        }
+      }
+    } catch (e) { }
+  }
+  if (isFile(path.join(p, 'index.js'))) {
+    return path.join(p, 'index.js');
+  }
+  return null;
+}
+
+function resolveModule (name, dir) {
+  if (/^\.{0,2}\//.test(name)) {
+    return resolveFile(path.resolve(dir, name));
+  }
+  // Builtins are precached by the runtime and never resolve here.
+  while (true) {
+    var resolved = resolveFile(path.join(dir, 'node_modules', name));
+    if (resolved || path.dirname(dir) == dir) {
+      return resolved;
+    }
+    dir = path.dirname(dir);
+  }
+}
+
+function dependencies (file) {
+  var seen = {}, queue = [path.resolve(file)], out = [];
+  while (queue.length) {
+    var next = queue.shift();
+    if (seen[next] || !/\.js$/.test(next)) {
+      continue;
+    }
+    seen[next] = true;
+    out.push(next);
+
+    var source;
+    try {
+      source = fs.readFileSync(next, 'utf-8');
+    } catch (e) {
+      continue;
+    }
+    var match;
+    REQUIRE_RE.lastIndex = 0;
+    while ((match = REQUIRE_RE.exec(source))) {
+      var resolved = resolveModule(match[2], path.dirname(next));
+      if (resolved) {
+        queue.push(resolved);
+      }
+    }
+  }
+  return out;
+}
+
+// Bytecode is named after the absolute path, which colony includes in its
+// cache key for that reason.
+function compile (file, jit, next) {
+  try {
+    var source = fs.readFileSync(file, 'utf-8');
+    var colonized = colonyCompiler.colonize(source, {
+      embedLineNumbers: true
+    });
+    if (jit) {
+      next(null, colonized.source);
+    } else {
+      colonyCompiler.toBytecode(colonized, '@' + path.resolve(file), next);
+    }
+  } catch (e) {
+    next(e);
+  }
+}
+
+function respond (status, data) {
+  var buf = Buffer.isBuffer(data) ? data : new Buffer(String(data));
+  process.stdout.write(status + ' ' + buf.length + '\n');
+  process.stdout.write(buf);
+}
+
+// Requests are handled strictly in order.
+var lines = [], pending = '', busy = false;
+
+function handle () {
+  if (busy || !lines.length) {
+    return;
+  }
+  var args = lines[0].split(' ');
+  var cmd = args.shift();
+
+  if (cmd == 'deps') {
+    lines.shift();
+    var files = dependencies(args.join(' '));
+    process.stdout.write(files.length + '\n' + files.map(function (f) {
+      return f + '\n';
+    }).join(''));
+    return handle();
+  }
+
+  if (cmd == 'compile') {
+    var count = parseInt(args[1]);
+    if (lines.length < count + 1) {
+      return;
+    }
+    var jit = args[0] == 'jit';
+    var batch = lines.splice(0, count + 1).slice(1);
+
+    busy = true;
+    (function loop (i) {
+      if (i == batch.length) {
+        busy = false;
+        return handle();
+      }
+      compile(batch[i], jit, function (err, out) {
+        if (err) {
+          // Not reported here: the file may never be required.
+          respond('error', err.message || err);
+        } else {
+          respond('ok', out);
+        }
+        loop(i + 1);
+      });
+    })(0);
+    return;
+  }
+
+  lines.shift();
+  console.error('colony-compiler-server: unknown request ' + JSON.stringify(cmd));
+  process.exit(1);
+}
+
+if (process.argv.length > 3) {
+  compile(process.argv[3], process.argv[2] == 'jit', function (err, out) {
+    if (err) {
+      console.error(process.argv[3] + ': ' + (err.stack || err));
+      process.exit(1);
+    }
+    process.stdout.write(out);
+  });
+} else {
+  process.stdin.on('data', function (data) {
+    var chunks = (pending + data.toString('utf-8')).split('\n');
+    pending = chunks.pop();
+    lines.push.apply(lines, chunks);
+    handle();
+  });
+  process.stdin.on('end', function () {
+    process.exit(0);
+  });
+  process.stdin.resume();
+  process.stdout.write('ready\n');
+}
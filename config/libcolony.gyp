@@ -147,6 +147,7 @@
             '<(runtime_path)/colony/modules/fs.js',
             '<(runtime_path)/colony/modules/http.js',
             '<(runtime_path)/colony/modules/https.js',
+            '<(runtime_path)/colony/modules/json_stream.js',
             '<(runtime_path)/colony/modules/net.js',
             '<(runtime_path)/colony/modules/os.js',
             '<(node_libs_path)/path.js',
@@ -201,12 +202,15 @@
       'cflags': [ '-Wall', '-Wextra', '-Werror' ],
       'defines': [
         'COLONY_COMPILER_PATH=<(compiler_path)',
+        'COLONY_COMPILER_SERVER_PATH=<(compiler_server_path)',
         'COLONY_NODE_VERSION=<(node_version)',
         '__TESSEL_RUNTIME_SEMVER__=<!(node -p \"require(\\\"../package.json\\\").version")',
       ],
       "sources": [
         '<(runtime_path)/tm_event.c',
         '<(runtime_path)/tm_timer.c',
+        '<(runtime_path)/tm_watch.c',
+        '<(runtime_path)/tm_immediate.c',
         '<(runtime_path)/colony/lua_hsregex.c',
         '<(runtime_path)/colony/lua_tm.c',
         '<(runtime_path)/colony/lua_rapidjson.c',
@@ -505,6 +505,8 @@
         '<(runtime_path)/tm_utf7.c',
         '<(runtime_path)/tm_utf8.c',
         '<(runtime_path)/tm_utf16.c',
+        '<(runtime_path)/tm_base64.c',
+        '<(runtime_path)/tm_json_stream.c',
       ],
       "include_dirs": [
         '<(runtime_path)/',
@@ -29,6 +29,66 @@ var StringDecoder;
 
 util.inherits(Readable, Stream);
 
+// Chunks waiting to be read. A linked list rather than an array, so that
+// taking the first chunk is O(1); Array#shift moves every element.
+function BufferList() {
+  this.head = null;
+  this.tail = null;
+  this.length = 0;
+}
+
+BufferList.prototype.push = function(v) {
+  var entry = { data: v, next: null };
+  if (this.length > 0)
+    this.tail.next = entry;
+  else
+    this.head = entry;
+  this.tail = entry;
+  ++this.length;
+};
+
+BufferList.prototype.unshift = function(v) {
+  var entry = { data: v, next: this.head };
+  if (this.length === 0)
+    this.tail = entry;
+  this.head = entry;
+  ++this.length;
+};
+
+BufferList.prototype.shift = function() {
+  if (this.length === 0)
+    return;
+  var ret = this.head.data;
+  if (this.length === 1)
+    this.head = this.tail = null;
+  else
+    this.head = this.head.next;
+  --this.length;
+  return ret;
+};
+
+BufferList.prototype.clear = function() {
+  this.head = this.tail = null;
+  this.length = 0;
+};
+
+BufferList.prototype.join = function(s) {
+  var parts = [];
+  for (var p = this.head; p; p = p.next)
+    parts.push(p.data);
+  return parts.join(s);
+};
+
+BufferList.prototype.concat = function(n) {
+  var ret = new Buffer(n);
+  var i = 0;
+  for (var p = this.head; p; p = p.next) {
+    p.data.copy(ret, i);
+    i += p.data.length;
+  }
+  return ret;
+};
+
 function ReadableState(options, stream) {
   options = options || {};
 
@@ -40,7 +100,7 @@ function ReadableState(options, stream) {
   // cast to ints.
   this.highWaterMark = ~~this.highWaterMark;
 
-  this.buffer = [];
+  this.buffer = new BufferList();
   this.length = 0;
   this.pipes = null;
   this.pipesCount = 0;
@@ -221,7 +281,7 @@ function howMuchToRead(n, state) {
   if (n === null || isNaN(n)) {
     // only flow one buffer at a time
     if (state.flowing && state.buffer.length)
-      return state.buffer[0].length;
+      return state.buffer.head.data.length;
     else
       return state.length;
   }
@@ -880,18 +940,20 @@ function fromList(n, state) {
     // read it all, truncate the array.
     if (stringMode)
       ret = list.join('');
+    else if (list.length === 1)
+      ret = list.head.data;
     else
-      ret = Buffer.concat(list, length);
-    list.length = 0;
+      ret = list.concat(length);
+    list.clear();
   } else {
     // read just some of it.
-    if (n < list[0].length) {
+    if (n < list.head.data.length) {
       // just take a part of the first list item.
       // slice is the same for buffers and strings.
-      var buf = list[0];
+      var buf = list.head.data;
       ret = buf.slice(0, n);
-      list[0] = buf.slice(n);
-    } else if (n === list[0].length) {
+      list.head.data = buf.slice(n);
+    } else if (n === list.head.data.length) {
       // first list is a perfect match
       ret = list.shift();
     } else {
@@ -904,7 +966,7 @@ function fromList(n, state) {
 
       var c = 0;
       for (var i = 0, l = list.length; i < l && c < n; i++) {
-        var buf = list[0];
+        var buf = list.head.data;
         var cpy = Math.min(n - c, buf.length);
 
         if (stringMode)
@@ -913,7 +975,7 @@ function fromList(n, state) {
           buf.copy(ret, c, 0, cpy);
 
         if (cpy < buf.length)
-          list[0] = buf.slice(cpy);
+          list.head.data = buf.slice(cpy);
         else
           list.shift();
 
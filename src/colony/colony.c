@@ -72,50 +72,302 @@ size_t colony_array_length_i (lua_State* L, int pos)
   return ret;
 }
 
-int colony_isbuffer (lua_State *L, int index)
+/**
+ * Buffers
+ *
+ * A Buffer is a JavaScript object that shares one metatable with every other
+ * Buffer. Its bytes are held by a colony_buffer_t userdata, which is found
+ * through a weak-keyed table in the registry. Creating a Buffer therefore
+ * costs one table and one userdata.
+ */
+
+#define COLONY_BUFFER_MT "colony_buffer_mt"
+#define COLONY_BUFFER_STORE "colony_buffer_store"
+#define COLONY_BUFFER_ROOTS "colony_buffer_roots"
+
+#define colony_absindex(L, i) ((i) > 0 || (i) <= LUA_REGISTRYINDEX ? (i) : lua_gettop(L) + (i) + 1)
+
+typedef struct colony_buffer {
+  uint8_t* data;
+  size_t length;
+} colony_buffer_t;
+
+// Looks up the backing store of the Buffer at index in the store at store_index.
+static colony_buffer_t* colony_buffer_lookup (lua_State* L, int store_index, int index)
 {
-  int ret = 0;
-  if (lua_getmetatable(L, index)) {
-    lua_getfield(L, -1, "buffer");
-    if (!lua_isnil(L, -1)) {
-      ret = 1;
+  colony_buffer_t* b = NULL;
+  if (lua_type(L, index) == LUA_TTABLE && lua_istable(L, store_index)) {
+    lua_pushvalue(L, index);
+    lua_rawget(L, store_index);
+    b = (colony_buffer_t*) lua_touserdata(L, -1);
+    lua_pop(L, 1);
+  }
+  return b;
+}
+
+static colony_buffer_t* colony_tobufferstore (lua_State* L, int index)
+{
+  index = colony_absindex(L, index);
+  lua_getfield(L, LUA_REGISTRYINDEX, COLONY_BUFFER_STORE);
+  // The store entry stays referenced for as long as the Buffer does.
+  colony_buffer_t* b = colony_buffer_lookup(L, lua_gettop(L), index);
+  lua_pop(L, 1);
+  return b;
+}
+
+static void colony_buffer_setbyte (colony_buffer_t* b, size_t index, double value)
+{
+  if (value < 0) {
+    b->data[index] = 0x100 - (((uint32_t) -value) % 0x100);
+  } else {
+    b->data[index] = (((uint32_t) value) % 0x100);
+  }
+}
+
+static int colony_isbufferlength (lua_State* L, int index)
+{
+  size_t len = 0;
+  const char* key = lua_tolstring(L, index, &len);
+  return len == 6 && !memcmp(key, "length", 6);
+}
+
+// Finds the store of the Buffer at or behind index. An object derived from a
+// Buffer has no store of its own, so follow its proto chain to the Buffer.
+static colony_buffer_t* colony_buffer_owner (lua_State* L, int store_index, int index)
+{
+  colony_buffer_t* b = colony_buffer_lookup(L, store_index, index);
+  if (b != NULL) {
+    return b;
+  }
+
+  int top = lua_gettop(L);
+  lua_pushvalue(L, index);
+  while (b == NULL && lua_getmetatable(L, -1) != 0) {
+    lua_getfield(L, -1, "proto");
+    if (!lua_istable(L, -1)) {
+      break;
     }
-    lua_pop(L, 2);
+    b = colony_buffer_lookup(L, store_index, lua_gettop(L));
   }
-  return ret;
+  lua_settop(L, top);
+  return b;
 }
 
-static uint8_t* colony_getbufferptr (lua_State *L, int index, size_t* buf_len)
+// __index(self, key, [_self]). _self is passed by js_proto_get when a Buffer
+// is the prototype of another object.
+static int colony_buffer_index (lua_State* L)
 {
-  uint8_t* buf = NULL;
-  if (lua_getmetatable(L, index)) {
-    lua_getfield(L, -1, "buffer");
+  int owner = lua_isnoneornil(L, 3) ? 1 : 3;
+
+  if (lua_type(L, 2) == LUA_TNUMBER) {
+    colony_buffer_t* b = colony_buffer_owner(L, lua_upvalueindex(1), owner);
+    double n = lua_tonumber(L, 2);
+    if (b != NULL && n >= 0 && n < b->length) {
+      lua_pushnumber(L, b->data[(size_t) n]);
+    } else {
+      lua_pushnil(L);
+    }
+    return 1;
+  }
+
+  if (lua_type(L, 2) == LUA_TSTRING && colony_isbufferlength(L, 2)) {
+    colony_buffer_t* b = colony_buffer_owner(L, lua_upvalueindex(1), owner);
+    lua_pushnumber(L, b != NULL ? b->length : 0);
+    return 1;
+  }
+
+  if (lua_getmetatable(L, owner) == 0) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  // Getters added through __defineGetter__ or Object.defineProperty.
+  lua_getfield(L, -1, "getters");
+  if (lua_istable(L, -1)) {
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
     if (!lua_isnil(L, -1)) {
-      buf = lua_touserdata(L, -1);
-      if (buf_len != NULL) {
-        lua_getfield(L, -2, "bufferlen");
-        *buf_len = lua_tonumber(L, -1);
-        lua_remove(L, -1);
+      lua_pushvalue(L, 1);
+      lua_call(L, 1, 1);
+      return 1;
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+
+  // js_proto_get(self, mt.proto, key)
+  lua_pushvalue(L, lua_upvalueindex(2));
+  lua_pushvalue(L, 1);
+  lua_getfield(L, -3, "proto");
+  lua_pushvalue(L, 2);
+  lua_call(L, 3, 1);
+  return 1;
+}
+
+// __newindex(self, key, value)
+static int colony_buffer_newindex (lua_State* L)
+{
+  if (lua_type(L, 2) == LUA_TNUMBER) {
+    colony_buffer_t* b = colony_buffer_lookup(L, lua_upvalueindex(1), 1);
+    double n = lua_tonumber(L, 2);
+    if (b != NULL && n >= 0 && n < b->length) {
+      colony_buffer_setbyte(b, (size_t) n, lua_tonumber(L, 3));
+    }
+    return 0;
+  }
+
+  // length is read-only.
+  if (lua_type(L, 2) == LUA_TSTRING && colony_isbufferlength(L, 2)) {
+    return 0;
+  }
+
+  if (lua_getmetatable(L, 1) != 0) {
+    lua_getfield(L, -1, "setters");
+    if (lua_istable(L, -1)) {
+      lua_pushvalue(L, 2);
+      lua_rawget(L, -2);
+      if (!lua_isnil(L, -1)) {
+        lua_pushvalue(L, 1);
+        lua_pushvalue(L, 3);
+        lua_call(L, 2, 0);
+        return 0;
       }
     }
-    lua_remove(L, -1);
-    lua_remove(L, -1);
+    lua_settop(L, 3);
   }
-  return buf;
+
+  lua_rawset(L, 1);
+  return 0;
+}
+
+void colony_buffer_init (lua_State* L)
+{
+  // Both tables are weak-keyed, so entries go away with their Buffer or view.
+  lua_newtable(L);
+  lua_pushliteral(L, "k");
+  lua_setfield(L, -2, "__mode");
+  lua_pushvalue(L, -1);
+  lua_setmetatable(L, -2);
+  lua_setfield(L, LUA_REGISTRYINDEX, COLONY_BUFFER_ROOTS);
+
+  lua_newtable(L);
+  lua_pushliteral(L, "k");
+  lua_setfield(L, -2, "__mode");
+  lua_pushvalue(L, -1);
+  lua_setmetatable(L, -2);
+  // stack: store
+
+  lua_newtable(L);
+  // stack: store, mt
+  lua_pushvalue(L, -2);
+  lua_getglobal(L, "js_proto_get");
+  lua_pushcclosure(L, colony_buffer_index, 2);
+  lua_setfield(L, -2, "__index");
+  lua_pushvalue(L, -2);
+  lua_pushcclosure(L, colony_buffer_newindex, 1);
+  lua_setfield(L, -2, "__newindex");
+  lua_pushboolean(L, 1);
+  lua_setfield(L, -2, "buffer");
+  lua_pushboolean(L, 1);
+  lua_setfield(L, -2, "shared");
+
+  lua_setfield(L, LUA_REGISTRYINDEX, COLONY_BUFFER_MT);
+  lua_setfield(L, LUA_REGISTRYINDEX, COLONY_BUFFER_STORE);
+}
+
+void colony_buffer_metatable (lua_State* L)
+{
+  lua_getfield(L, LUA_REGISTRYINDEX, COLONY_BUFFER_MT);
+}
+
+int colony_isbuffer (lua_State *L, int index)
+{
+  return colony_tobufferstore(L, index) != NULL;
+}
+
+static uint8_t* colony_getbufferptr (lua_State *L, int index, size_t* buf_len)
+{
+  colony_buffer_t* b = colony_tobufferstore(L, index);
+  if (b == NULL) {
+    return NULL;
+  }
+  if (buf_len != NULL) {
+    *buf_len = b->length;
+  }
+  return b->data;
+}
+
+// Pushes a new Buffer backed by b. stack: b -> buffer
+static void colony_buffer_wrap (lua_State* L)
+{
+  lua_createtable(L, 0, 0);
+  lua_insert(L, -2);
+
+  // store[buffer] = b
+  lua_getfield(L, LUA_REGISTRYINDEX, COLONY_BUFFER_STORE);
+  lua_pushvalue(L, -3);
+  lua_pushvalue(L, -3);
+  lua_rawset(L, -3);
+  lua_pop(L, 2);
+
+  lua_getfield(L, LUA_REGISTRYINDEX, COLONY_BUFFER_MT);
+  lua_setmetatable(L, -2);
 }
 
 uint8_t* colony_createbuffer (lua_State* L, int size)
 {
-  lua_getglobal(L, "_colony");
-  lua_getfield(L, -1, "global");
-  lua_remove(L, -2);
-  lua_pushliteral(L,"Buffer");
-  lua_gettable(L, -2);
-  lua_remove(L, -2);
-  lua_pushnil(L);
-  lua_pushnumber(L, size);
-  lua_call(L,2,1);
-  return colony_getbufferptr(L, -1, NULL);
+  colony_buffer_t* b = (colony_buffer_t*) lua_newuserdata(L, sizeof(colony_buffer_t) + size);
+  b->data = (uint8_t*) (b + 1);
+  b->length = size;
+  colony_buffer_wrap(L);
+  return b->data;
+}
+
+// Pushes a Buffer sharing memory with the Buffer at index, like slice(). The
+// view holds no copy: its store points into the parent's bytes, and the
+// backing store is kept alive by an entry in the roots table. Views of views
+// root the original store, so chains of slices never pin each other.
+void colony_createbufferview (lua_State* L, int index, size_t start, size_t end)
+{
+  index = colony_absindex(L, index);
+  lua_getfield(L, LUA_REGISTRYINDEX, COLONY_BUFFER_STORE);
+  lua_pushvalue(L, index);
+  lua_rawget(L, -2);
+  colony_buffer_t* parent = (colony_buffer_t*) lua_touserdata(L, -1);
+  if (parent == NULL) {
+    lua_pop(L, 2);
+    colony_createbuffer(L, 0);
+    return;
+  }
+  if (end > parent->length) {
+    end = parent->length;
+  }
+  if (start > end) {
+    start = end;
+  }
+
+  // stack: store, parent
+  lua_getfield(L, LUA_REGISTRYINDEX, COLONY_BUFFER_ROOTS);
+  lua_pushvalue(L, -2);
+  lua_rawget(L, -2);
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    lua_pushvalue(L, -2);
+  }
+
+  // stack: store, parent, roots, root
+  colony_buffer_t* b = (colony_buffer_t*) lua_newuserdata(L, sizeof(colony_buffer_t));
+  b->data = parent->data + start;
+  b->length = end - start;
+
+  // roots[b] = root
+  lua_pushvalue(L, -1);
+  lua_pushvalue(L, -3);
+  lua_rawset(L, -5);
+
+  lua_insert(L, -5);
+  lua_pop(L, 4);
+  colony_buffer_wrap(L);
 }
 
 // you probably mean this instead of lua_pushlstring
@@ -35,11 +35,14 @@ void colony_runtime_arena_restore (void* _source, int source_max, void* _target,
 void colony_createarray (lua_State* L, int size);
 void colony_createobj (lua_State* L, int size, int proto);
 uint8_t* colony_createbuffer (lua_State* L, int size);
+void colony_createbufferview (lua_State* L, int index, size_t start, size_t end);
 void colony_pushbuffer (lua_State* L, const uint8_t* buf, size_t buf_len);
 const uint8_t* colony_toconstdata (lua_State* L, int index, size_t* buf_len);
 uint8_t* colony_tobuffer (lua_State* L, int index, size_t* buf_len);
 void colony_ipc_emit (lua_State* L, char *type, void* data, size_t size);
 int colony_isbuffer (lua_State *L, int index);
+void colony_buffer_init (lua_State* L);
+void colony_buffer_metatable (lua_State* L);
 int colony_isarray (lua_State* L, int index);
 void colony_array_length (lua_State* L, int pos);
 size_t colony_array_length_i (lua_State* L, int pos);
@@ -15,6 +15,8 @@
 
 #include <string.h>
 
+#include "colony.h"
+
 /*
 local function js_proto_get (self, proto, key)
    if key == '__proto__' then return proto; end
@@ -167,4 +169,6 @@ void colony_init (lua_State* L)
 
 	lua_pushcfunction(L, js_getter_index);
 	lua_setglobal(L, "js_getter_index");
+
+	colony_buffer_init(L);
 }
@@ -212,6 +212,10 @@ int colony_runtime_open ()
   lua_pushliteral(L, colony_runtime_xstr(COLONY_COMPILER_PATH));
   lua_setglobal(L, "COLONY_COMPILER_PATH");
 #endif
+#ifdef COLONY_COMPILER_SERVER_PATH
+  lua_pushliteral(L, colony_runtime_xstr(COLONY_COMPILER_SERVER_PATH));
+  lua_setglobal(L, "COLONY_COMPILER_SERVER_PATH");
+#endif
 #endif
 
   // Preload Lua modules.
@@ -83,13 +83,18 @@ function js_define_setter (self, key, fn)
   end
 
   rawset(self, key, nil)
+  -- Buffer metamethods already consult getters and setters.
   if not mt.getters then
     mt.getters = {}
-    mt.__index = js_getter_index
+    if not mt.buffer then
+      mt.__index = js_getter_index
+    end
   end
   if not mt.setters then
     mt.setters = {}
-    mt.__newindex = js_setter_index(mt.proto)
+    if not mt.buffer then
+      mt.__newindex = js_setter_index(mt.proto)
+    end
   end
 
   mt.setters[key] = fn
@@ -108,13 +113,18 @@ function js_define_getter (self, key, fn)
   end
   
   rawset(self, key, nil)
+  -- Buffer metamethods already consult getters and setters.
   if not mt.getters then
     mt.getters = {}
-    mt.__index = js_getter_index
+    if not mt.buffer then
+      mt.__index = js_getter_index
+    end
   end
   if not mt.setters then
     mt.setters = {}
-    mt.__newindex = js_setter_index(mt.proto)
+    if not mt.buffer then
+      mt.__newindex = js_setter_index(mt.proto)
+    end
   end
 
   mt.getters[key] = fn
@@ -225,6 +235,7 @@ function get_unique_metatable (this)
       __tostring = mt.__tostring,
       __tovalue = mt.__tovalue,
       proto = mt.proto,
+      buffer = mt.buffer,
       shared = false
     });
     return getmetatable(this)
@@ -266,12 +266,7 @@ str_proto.replace = function (this, match, out)
 end
 
 str_proto.concat = function (this, ...)
-  local args1 = table.pack(...)
-  local ret = tostring(this)
-  for i=1,args1.n do
-    ret = ret .. args1[i]
-  end
-  return ret
+  return tm.str_concat(this, ...)
 end
 
 -- object prototype
@@ -417,53 +412,19 @@ arr_proto.pop = function (this)
 end
 
 arr_proto.shift = function (this)
-  local len = tonumber(rawget(this, 'length'))
-  local ret = rawget(this, 0)
-  if len > 0 then
-    if len > 1 then
-      rawset(this, 0, table.remove(this, 1))
-    else
-      rawset(this, 0, nil)
-    end
-    rawset(this, 'length', len - 1)
-  end
-  return ret
+  return tm.arr_shift(this)
 end
 
-arr_proto.unshift = function (this, elem)
-  local len = rawget(this, 'length')
-  table.insert(this, 1, rawget(this, 0))
-  rawset(this, 0, elem)
-  rawset(this, 'length', len + 1)
-  return len + 1
+arr_proto.unshift = function (this, ...)
+  return tm.arr_unshift(this, ...)
 end
 
 arr_proto.splice = function (this, i, del, ...)
-  local original_len = tonumber(rawget(this, 'length'))
-  local del_len = math.min(original_len - i, tonumber(del) or 0)
-  local ret = {}
-  for j=1,del_len do
-    ret[j-1] = rawget(this, i)
-    if i == 0 then
-      rawset(this, 0, rawget(this, i))
-    end
-    if i == 0 then
-      arr_proto.shift(this)
-    else
-      table.remove(this, i)
-    end
+  i = tonumber(i) or 0
+  if i < 0 then
+    i = math.max(0, rawget(this, 'length') + i)
   end
-
-  local args = table.pack(...)
-  for j=1,args.n do
-    if i == 0 then
-      arr_proto.unshift(this, args[j])
-    else
-      table.insert(this, i, args[j])
-    end
-    i = i + 1
-  end
-  rawset(this, 'length', original_len - del_len + args.n)
+  local ret, del_len = tm.arr_splice(this, i, tonumber(del) or 0, ...)
   return js_arr(ret, del_len)
 end
 
@@ -521,42 +482,7 @@ arr_proto.concat = function (this, ...)
 end
 
 arr_proto.sort = function (this, fn)
-  -- shift from 0-based to 1-based index
-  table.insert(this, 1, this[0])
-  rawset(this, 0, nil)
-
-  -- sort
-  table.sort(this, function (a, b)
-    -- handle nil values
-    if b == nil and a ~= nil then
-      return true
-    end
-    if a == nil and b ~= nil then
-      return false
-    end
-
-    if not fn then
-      return (tostring(a) < tostring(b))
-    else
-      local comp = fn(this, a, b)
-      local tcomp = type(comp)
-      if tcomp == "number" then
-        return comp < 0
-      elseif tcomp == "boolean" then
-        if a == b then
-          return false
-        end
-        return not comp
-      end
-    end
-  end)
-
-  --  unshift
-  local tmp = rawget(this, 1)
-  table.remove(this, 1)
-  rawset(this, 0, tmp)
-
-  return this
+  return tm.arr_sort(this, fn)
 end
 
 arr_proto.join = function (this, ...)
@@ -570,15 +496,7 @@ arr_proto.join = function (this, ...)
     end
   end
 
-  local _r = ''
-  for i=0,this.length-1 do
-    if this[i] == nil or this[i] == _null then
-      _r = _r .. str
-    else
-      _r = _r .. tostring(this[i]) .. str
-      end
-  end
-  return string.sub(_r, 1, string.len(_r) - string.len(str))
+  return tm.str_join(this, tonumber(this.length) or 0, str, _null)
 end
 
 arr_proto.indexOf = function (this, searchElement, fromIndex)
@@ -1122,13 +1040,14 @@ global.String.prototype = str_proto
 str_proto.constructor = global.String
 global.String.fromCharCode = function (this, ...)
   -- http://es5.github.io/x15.5.html#x15.5.3.2
+  if select('#', ...) == 1 then
+    return tm.str_fromcode(math.floor(math.abs(tonumbervalue(...))) % (2^16))
+  end
   local args = table.pack(...)
-  local str = ''
   for i=1,args.n do
-    local uint16 = math.floor(math.abs(tonumbervalue(args[i]))) % (2^16)
-    str = str .. tm.str_fromcode(uint16)
+    args[i] = math.floor(math.abs(tonumbervalue(args[i]))) % (2^16)
   end
-  return str
+  return tm.str_fromcodes(args, args.n)
 end
 
 -- Math
@@ -1798,12 +1717,13 @@ if type(hs) == 'table' then
       patt = '(?i)' .. patt
     end
 
-    local cre = hs.regex_create()
-    local crestr, rc = hs.re_comp(cre, patt, hs.ADVANCED)
-    if rc ~= 0 then
-      error(js_new(global.SyntaxError, 'Invalid regex "' .. patt .. '" (error ' + tostring(rc or 0) + ')'))
+    -- Compiled regexes are cached and shared between RegExp objects, and
+    -- freed once none of them (nor the cache) refers to one.
+    local cre, regex_nsub = hs.regex_compile(patt, hs.ADVANCED)
+    if not cre then
+      error(js_new(global.SyntaxError, 'Invalid regex "' .. patt .. '" (error ' .. tostring(regex_nsub or 0) .. ')'))
     end
-    local regex_nsub = hs.regex_nsub(cre) + 1
+    regex_nsub = regex_nsub + 1
 
     local o = {}
     o.source = source
@@ -1814,24 +1734,10 @@ if type(hs) == 'table' then
     o.unicode = (flags and string.find(flags, "u") and true) or false
     o.sticky = (flags and string.find(flags, "y") and true) or false
 
-    -- Set a metatable on the created regex.
-    -- This way we can add a handler when the regex obj gets GC'ed
-    -- and then in turn force hsregex to free the created regex.
-    -- If we free this before hand, we're not guaranteed that the
-    -- regex won't get used later.
-    -- Had to add a `debug` here in order to set the metatable on userdata.
-    debug.setmetatable(cre, {
-      __gc = function(self)
-        -- force regex to free after it goes out of context
-        hs.regfree(self)
-      end
-    })
-
     setmetatable(o, {
       __index=global.RegExp.prototype,
       __tostring=js_tostring,
       cre=cre,
-      crestr=crestr,
       regex_nsub=regex_nsub,
       proto=global.RegExp.prototype
     })
@@ -1863,29 +1769,11 @@ if type(hs) == 'table' then
       regex = js_new(global.RegExp, regex)
     end
 
-    -- Match using hsregex
-    local cre = getmetatable(regex).cre
-    local crestr = getmetatable(regex).crestr
-    local regex_nsub = getmetatable(regex).regex_nsub
-    local hsmatch = hs.regmatch_create(regex_nsub)
-
     if rawget(regex, 'global') then
-      local data = tostring(this)
-      local ret, count, idx = {}, 0, 1
-      while true do
-        local rc = hs.re_exec(cre, string.sub(data, idx), nil, regex_nsub, hsmatch, 0)
-        if rc ~= 0 then
-          break
-        end
-
-        local so, eo = hs.regmatch_so(hsmatch, i), hs.regmatch_eo(hsmatch, i)
-        if so == -1 or eo == -1 then
-          break
-        end
-
-        rawset(ret, count, string.sub(data, idx + so, idx + eo - 1))
-        count = count + 1
-        idx = idx + eo
+      -- All matches are collected in one call
+      local ret, count = hs.regex_match_all(getmetatable(regex).cre, tostring(this))
+      if count == 0 then
+        return nil
       end
       return js_arr(ret, count)
     else
@@ -1896,7 +1784,6 @@ if type(hs) == 'table' then
 
   global.RegExp.prototype.exec = function (this, subj)
     local cre = getmetatable(this).cre
-    local crestr = getmetatable(this).crestr
     if type(cre) ~= 'userdata' then
       error(js_new(global.TypeError, 'Cannot call RegExp.prototype.exec on non-regex'))
     end
@@ -1904,8 +1791,7 @@ if type(hs) == 'table' then
     local hsmatch = hs.regmatch_create(regex_nsub)
 
     local input = tostring(subj)
-    local data = string.sub(input, this.lastIndex + 1)
-    local rc = hs.re_exec(cre, data, nil, regex_nsub, hsmatch, 0)
+    local rc = hs.re_exec(cre, input, this.lastIndex, regex_nsub, hsmatch, 0)
     if rc ~= 0 then
       -- Reset .lastIndex when no match found
       this.lastIndex = 0
@@ -1917,16 +1803,16 @@ if type(hs) == 'table' then
       if so == -1 or eo == -1 then
         table.insert(ret, len, nil)
       else
-        table.insert(ret, len, string.sub(data, so + 1, eo))
+        table.insert(ret, len, string.sub(input, so + 1, eo))
       end
       len = len + 1
     end
 
-    ret.index = this.lastIndex + hs.regmatch_so(hsmatch, 0)
+    ret.index = hs.regmatch_so(hsmatch, 0)
     ret.input = input
 
     if this.global then
-      this.lastIndex = this.lastIndex + hs.regmatch_eo(hsmatch, 0)
+      this.lastIndex = hs.regmatch_eo(hsmatch, 0)
     end
 
     return js_arr(ret, len)
@@ -1941,7 +1827,7 @@ if type(hs) == 'table' then
     local hsmatch = hs.regmatch_create(regex_nsub)
 
     -- TODO optimize by capturing no subgroups?
-    local rc = hs.re_exec(cre, tostring(subj), nil, regex_nsub, hsmatch, 0)
+    local rc = hs.re_exec(cre, tostring(subj), 0, regex_nsub, hsmatch, 0)
     return rc == 0
   end
 
@@ -2007,8 +1893,7 @@ end
 
 -- Parse JSON into an object.
 global.JSON.parse = function (this, value)
-  -- Non-object primitives require this wrapper.
-  return rapidjson.parse('{"value":\n' .. tostring(value) .. '\n}', json_error).value
+  return rapidjson.parse(value, json_error)
 end
 
 -- Stringify an object.
@@ -2016,23 +1901,14 @@ global.JSON.stringify = function (this, value, replacer, spacer)
   -- Fix spacer argument
   if type(spacer) == 'number' then
     spacer = string.rep(' ', spacer)
-  else
-    spacer = tostring(spacer or '')
+  elseif type(spacer) ~= 'string' then
+    spacer = nil
   end
-  spacer = string.sub(spacer, 1, 10)
-
-  -- Call writer.
-  local wh = rapidjson.create_writer(spacer)
-  local status, err = pcall(rapidjson.write_value, wh, value, replacer, nil, {[""] = value})
-  if not status then
-    rapidjson.destroy(wh)
-    error(err)
+  if spacer then
+    spacer = string.sub(spacer, 1, 10)
   end
-  local str = rapidjson.result(wh)
-  rapidjson.destroy(wh)
 
-  -- Return code.
-  return tostring(str)
+  return rapidjson.stringify(value, replacer, spacer)
 end
 
 --[[
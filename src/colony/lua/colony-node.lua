@@ -81,11 +81,11 @@ function wrap_timer_cb(timerfn, ...)
   end
 
   -- If extra args were passed, encapsulate them in a closure
-  if select("#", ...) then
+  if select("#", ...) > 0 then
     local timerfn_call = timerfn
     local args = table.pack(...)
     timerfn = function()
-      timerfn_call(global, unpack(args))
+      timerfn_call(global, unpack(args, 1, args.n))
     end
   end
   return timerfn
@@ -103,8 +103,10 @@ global.setInterval = function (this, fn, timeout, ...)
   return tm.set_raw_timeout(timeout, true, wrap_timer_cb(fn, ...))
 end
 
+-- Immediates have their own queue, so they run in order on the next turn of
+-- the event loop without a trip through the timer heap.
 global.setImmediate = function (this, fn, ...)
-  return tm.set_raw_timeout(0, false, wrap_timer_cb(fn, ...))
+  return tm.set_immediate(wrap_timer_cb(fn, ...))
 end
 
 global.clearTimeout = function (this, id)
@@ -112,102 +114,18 @@ global.clearTimeout = function (this, id)
 end
 
 global.clearInterval = global.clearTimeout
-global.clearImmediate = global.clearTimeout
+global.clearImmediate = function (this, id)
+  tm.clear_immediate(id)
+end
 
 
 --[[
 --|| Buffer
 --]]
 
---------------BASE64
--- some unoptimized base64 functions
--- Sourced from http://en.wikipedia.org/wiki/Base64
--- https://raw.github.com/toastdriven/lua-base64/master/base64.lua
-
-local index_table = 'ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/'
-
-function to_binary(integer)
-    local remaining = tonumber(integer)
-    local bin_bits = ''
-
-    for i = 7, 0, -1 do
-        local current_power = math.pow(2, i)
-
-        if remaining >= current_power then
-            bin_bits = bin_bits .. '1'
-            remaining = remaining - current_power
-        else
-            bin_bits = bin_bits .. '0'
-        end
-    end
-
-    return bin_bits
-end
-
-function from_binary(bin_bits)
-    return tonumber(bin_bits, 2)
-end
-
-function to_base64(to_encode)
-    local bit_pattern = ''
-    local encoded = ''
-    local trailing = ''
-
-    for i = 1, string.len(to_encode) do
-        bit_pattern = bit_pattern .. to_binary(string.byte(string.sub(to_encode, i, i)))
-    end
-
-    -- Check the number of bytes. If it's not evenly divisible by three,
-    -- zero-pad the ending & append on the correct number of ``=``s.
-    if math.mod(string.len(bit_pattern), 3) == 2 then
-        trailing = '=='
-        bit_pattern = bit_pattern .. '0000000000000000'
-    elseif math.mod(string.len(bit_pattern), 3) == 1 then
-        trailing = '='
-        bit_pattern = bit_pattern .. '00000000'
-    end
-
-    for i = 1, string.len(bit_pattern), 6 do
-        local byte = string.sub(bit_pattern, i, i+5)
-        local offset = tonumber(from_binary(byte))
-        encoded = encoded .. string.sub(index_table, offset+1, offset+1)
-    end
-
-    return string.sub(encoded, 1, -1 - string.len(trailing)) .. trailing
-end
-
-function from_base64(to_decode)
-  local padded = string.gsub(to_decode, "%s", "")
-  local unpadded = string.gsub(padded, "=", "")
-  local bit_pattern = ''
-  local decoded = ''
-
-  for i = 1, string.len(unpadded) do
-    local char = string.sub(to_decode, i, i)
-    local offset, _ = string.find(index_table, char)
-    if offset == nil then
-      return ''
-    end
-
-    bit_pattern = bit_pattern .. string.sub(to_binary(offset-1), 3)
-  end
-
-  -- trim off unused bits
-  bit_pattern = string.sub(bit_pattern, 1, string.len(bit_pattern) - ((string.len(bit_pattern) % (4*8)) - ((string.len(unpadded) % 4) * 8)))
-
-  for i = 1, string.len(bit_pattern), 8 do
-    local byte = string.sub(bit_pattern, i, i+7)
-    decoded = decoded .. string.char(from_binary(byte))
-  end
-
-  return decoded
-end
--------------/BASE64
-
 local buffer_proto = js_obj({
   fill = function (this, value, offset, endoffset)
-    local sourceBuffer = getmetatable(this).buffer
-    local sourceBufferLength = getmetatable(this).bufferlen
+    local sourceBufferLength = this.length
     offset = tonumber(offset)
     endoffset = tonumber(endoffset)
     if not offset or offset > sourceBufferLength then
@@ -216,7 +134,7 @@ local buffer_proto = js_obj({
     if (not endoffset and endoffset ~= 0) or endoffset > sourceBufferLength then
       endoffset = sourceBufferLength
     end
-    tm.buffer_fill(sourceBuffer, value, offset, endoffset)
+    tm.buffer_fill(this, value, offset, endoffset)
   end,
   slice = function (this, sourceStart, len)
     sourceStart = tonumber(sourceStart or 0) or 0
@@ -233,16 +151,12 @@ local buffer_proto = js_obj({
       len = this.length
     end
 
-    local sourceBuffer = getmetatable(this).buffer
-    local sourceBufferLength = getmetatable(this).bufferlen
-    return _of_buffer({}, tm.buffer_index(sourceBuffer, sourceStart), len - sourceStart)
+    return tm.buffer_slice(this, sourceStart, len)
   end,
   copy = function (this, target, targetStart, sourceStart, sourceEnd)
-    local sourceBuffer = getmetatable(this).buffer
-    local sourceBufferLength = getmetatable(this).bufferlen
-    local targetBuffer = getmetatable(target).buffer
-    local targetBufferLength = getmetatable(target).bufferlen
-    if not sourceBuffer or not targetBuffer then
+    local sourceBufferLength = tm.buffer_length(this)
+    local targetBufferLength = tm.buffer_length(target)
+    if not sourceBufferLength or not targetBufferLength then
       error(js_new(global.TypeError, 'Buffer::copy requires a buffer source and buffer target'))
     end
     targetStart = tonumber(targetStart)
@@ -270,7 +184,7 @@ local buffer_proto = js_obj({
     if sourceEnd - sourceStart > targetBufferLength - targetStart then
       sourceEnd = sourceStart + (targetBufferLength - targetStart)
     end
-    tm.buffer_copy(sourceBuffer, targetBuffer, targetStart, sourceStart, sourceEnd)
+    tm.buffer_copy(this, target, targetStart, sourceStart, sourceEnd)
   end,
   write = function (this, string, offset, length, encoding)
     if type(offset) == 'string' then
@@ -295,8 +209,7 @@ local buffer_proto = js_obj({
   end,
   toString = function (this, encoding, offset, endOffset)
 
-    local sourceBuffer = getmetatable(this).buffer
-    local sourceBufferLength = getmetatable(this).bufferlen;
+    local sourceBufferLength = this.length
 
     if offset == nil or offset < 0 then
       offset = 0
@@ -315,63 +228,48 @@ local buffer_proto = js_obj({
     end
     encoding = string.lower(encoding)
     
-    local buf = tm.buffer_tobytestring(getmetatable(this).buffer, offset, endOffset)
     if encoding == 'binary' then
-      return tm.str_from_binary(buf);
+      return tm.str_from_binary(tm.buffer_tobytestring(this, offset, endOffset));
     elseif encoding == 'ascii' then
-      return tm.str_from_ascii(buf);
+      return tm.str_from_ascii(tm.buffer_tobytestring(this, offset, endOffset));
     elseif encoding == 'utf8' or encoding == 'utf-8' then
-      return tm.str_from_utf8(buf);
+      return tm.str_from_utf8(tm.buffer_tobytestring(this, offset, endOffset));
     elseif encoding == 'ucs2' or encoding == 'ucs-2' or encoding == 'utf16le' or encoding == 'utf-16le' then
-      return tm.str_from_utf16le(buf);
+      return tm.str_from_utf16le(tm.buffer_tobytestring(this, offset, endOffset));
     elseif encoding == 'base64' then
-      return tm.str_from_binary(to_base64(buf));
+      return tm.base64_encode(this, offset, endOffset)
     elseif encoding == 'hex' then
-      local str = string.gsub(buf, '(.)', function (c)
-        return string.format('%02x', string.byte(c));
-      end)
-      return str;
+      return tm.buffer_tohex(this, offset, endOffset)
     else
       error(js_new(global.TypeError, 'Unknown encoding: ' + encoding));
     end
   end,
   toJSON = function (this)
-    local arr = {}
-    local len = this.length
-    local lenmax = len - 1
-    for i=0,lenmax do
-      arr[i] = this[i]
-    end
-    return js_arr(arr, len)
+    return js_arr(tm.buffer_toarray(this), this.length)
   end,
   inspect = function (this)
-    local sourceBuffer = getmetatable(this).buffer
-    local sourceBufferLength = getmetatable(this).bufferlen
+    local sourceBufferLength = this.length
 
     local out = {'<Buffer'}
     local maxbytes = colony.run('buffer').INSPECT_MAX_BYTES    -- HACK: need *module* object
     -- NOTE: we differ from current node.js, see https://github.com/joyent/node/issues/7995
-    for i=0,math.min(sourceBufferLength or 0, maxbytes)-1 do
-      table.insert(out, string.format("%02x", this[i]))
+    if sourceBufferLength > 0 and maxbytes > 0 then
+      table.insert(out, tm.buffer_tohex(this, 0, math.min(sourceBufferLength, maxbytes), ' '))
     end
     if sourceBufferLength > maxbytes then
       table.insert(out, '...')
     end
-    return table.concat(out, ' ') + '>'
+    return table.concat(out, ' ') .. '>'
   end,
 
   -- Internal use only
   _random = function (this)
-    local sourceBuffer = getmetatable(this).buffer
-    local sourceBufferLength = getmetatable(this).bufferlen
-
-    return tm.random_bytes(sourceBuffer, 0, tonumber(sourceBufferLength));
+    return tm.random_bytes(this, 0, this.length);
   end
 })
 
 function read_buf (this, pos, no_assert, size, fn, le)
-  local sourceBuffer = getmetatable(this).buffer
-  local sourceBufferLength = getmetatable(this).bufferlen
+  local sourceBufferLength = this.length
   pos = tonumber(pos)
 
   if not (pos >= 0 and pos <= sourceBufferLength - size) then
@@ -388,11 +286,11 @@ function read_buf (this, pos, no_assert, size, fn, le)
     end
     local tmp = tm.buffer_create(4)
     tm.buffer_fill(tmp, 0, 0, 4)
-    tm.buffer_copy(sourceBuffer, tmp, 0, pos, sourceBufferLength)
+    tm.buffer_copy(this, tmp, 0, pos, sourceBufferLength)
     return fn(tmp, 0, le)
   end
 
-  return fn(sourceBuffer, pos, le)
+  return fn(this, pos, le)
 end
 
 buffer_proto.readUInt8 = function (this, pos, opts) return read_buf(this, pos, opts, 1, tm.buffer_read_uint8, 0); end
@@ -412,8 +310,7 @@ buffer_proto.readDoubleLE = function (this, pos, opts) return read_buf(this, pos
 buffer_proto.readDoubleBE = function (this, pos, opts) return read_buf(this, pos, opts, 8, tm.buffer_read_double, 0); end
 
 function write_buf (this, value, pos, no_assert, size, fn, le)
-  local sourceBuffer = getmetatable(this).buffer
-  local sourceBufferLength = getmetatable(this).bufferlen
+  local sourceBufferLength = this.length
   pos = tonumber(pos)
 
   if not (pos >= 0 and pos <= sourceBufferLength - size) then
@@ -424,11 +321,11 @@ function write_buf (this, value, pos, no_assert, size, fn, le)
     local tmp = tm.buffer_create(4)
     tm.buffer_fill(tmp, 0, 0, 4)
     fn(tmp, 0, value, le)
-    tm.buffer_copy(tmp, sourceBuffer, pos, 0, sourceBufferLength - pos)
+    tm.buffer_copy(tmp, this, pos, 0, sourceBufferLength - pos)
     return
   end
 
-  return fn(sourceBuffer, pos, value, le)
+  return fn(this, pos, value, le)
 end
 
 buffer_proto.writeUInt8 = function (this, value, pos, opts) return write_buf(this, value, pos, opts, 1, tm.buffer_write_uint8); end
@@ -448,56 +345,11 @@ buffer_proto.writeDoubleLE = function (this, value, pos, opts) return write_buf(
 buffer_proto.writeDoubleBE = function (this, value, pos, opts) return write_buf(this, value, pos, opts, 8, tm.buffer_write_double, 0); end
 
 
-function _of_buffer (this, buf, length)
-  setmetatable(this, {
-    buffer = buf,
-    bufferlen = length,
-    getters = {
-      length = function ()
-        return length
-      end
-    },
-    setters = {},
-    values = {},
-    __newindex = function (self, key, value)
-      local n = tonumber(key)
-      if n == key then
-        if n < length and n >= 0 then
-          tm.buffer_set(buf, n, tonumber(value))
-        end
-        return
-      end
-
-      -- js_setter_index ...
-      local mt = getmetatable(self)
-      local setter = mt.setters[key]
-      if setter then
-        return setter(self, value)
-      end
-      rawset(mt.values, key, value)
-    end,
-    __index = function (self, key, _self)
-      local n = tonumber(key)
-      if n == key then
-        if n < length and n >= 0 then
-          return tm.buffer_get(buf, n)
-        end
-        return nil
-      end
-
-      -- js_getter_index ...
-      local mt = getmetatable(_self or self)
-      local getter = mt.getters[key]
-      if getter then
-        return getter(self)
-      end
-      return mt.values[key] or js_proto_get(self, buffer_proto, key)
-    end,
-    __tostring = js_tostring,
-    proto = buffer_proto
-  })
-  return this
-end
+-- All Buffers share this metatable. Indexing and length are handled in C
+-- (see colony.c); everything else falls through to buffer_proto.
+local buffer_mt = tm.buffer_metatable()
+buffer_mt.proto = buffer_proto
+buffer_mt.__tostring = js_tostring
 
 local function Buffer (this, arg, encoding)
   if encoding == nil then
@@ -520,43 +372,26 @@ local function Buffer (this, arg, encoding)
   elseif encoding == 'ucs2' or encoding == 'ucs-2' or encoding == 'utf16le' or encoding == 'utf-16le' then
     raw = tm.str_to_utf16le(arg)
   elseif encoding == 'base64' then
-    raw = from_base64(tm.str_to_binary(arg))
+    return tm.base64_decode(arg)
   elseif encoding == 'hex' then
     if string.len(arg) % 2 ~= 0 then
       error(js_new(global.TypeError, 'Invalid hex string.'))
     end
-    hex = string.lower(string.gsub(arg, '[^a-fA-F0-9].*', ''))
+    hex = arg
   else
     error(js_new(global.TypeError, 'Unknown encoding: ' + encoding));
   end
   
-  if type(size) == 'number' then
-    -- all set
+  -- Each source is copied or decoded into the new Buffer in a single pass.
+  if size then
+    return tm.buffer_create(size)
   elseif arr then
-    size = arr.length
+    return tm.buffer_from_array(arr, arr.length)
   elseif hex then
-    size = #hex / 2
+    return tm.buffer_from_hex(hex)
   else
-    size = #raw
+    return tm.buffer_from_string(raw)
   end
-  
-  this = {}
-  local buf = tm.buffer_create(size)
-  _of_buffer(this, buf, size)
-  if arr then
-    for i = 1, size do
-      this[i - 1] = arr[i - 1]
-    end
-  elseif hex then
-    for i = 1, #hex, 2 do
-      this[(i - 1)/2] = tonumber(string.sub(hex, i, i+1), 16)
-    end
-  elseif raw then
-    for i = 1, size do
-      this[i - 1] = string.byte(raw, i)
-    end
-  end
-  return this
 end
 
 Buffer.prototype = buffer_proto
@@ -678,28 +513,25 @@ end
 -- Copied and adapted from http://dev.alpinelinux.org/alpine/acf/core/acf-core-0.4.20.tar.bz2/acf-core-0.4.20/lib/fs.lua
 
 function colony_buffertorawstr (buf)
-  local sourceBuffer = getmetatable(buf).buffer
-  local sourceBufferLength = getmetatable(buf).bufferlen
-
-  return tm.buffer_tobytestring(sourceBuffer, 0, sourceBufferLength)
+  return tm.buffer_tobytestring(buf, 0, buf.length)
 end
 
 function fs_readfile (name)
   local prefix = ''
   fd, err = tm.fs_open(prefix..name, tm.RDWR + tm.OPEN_EXISTING)
   assert(fd and err == 0)
-  local s = ''
+  local s = tm.strbuf_create()
   while true do
     local chunk = tm.fs_read(fd, 16*1024)
     if chunk ~= nil then
-      s = s .. colony_buffertorawstr(chunk)
+      tm.strbuf_append(s, colony_buffertorawstr(chunk))
     end
     if chunk == nil then
       break
     end
   end
   tm.fs_close(fd)
-  return s
+  return tm.strbuf_tostring(s)
   -- local fp = assert(io.open(prefix..name))
   -- local s = fp:read("*a")
   -- assert(fp:close())
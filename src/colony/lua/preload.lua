@@ -74,21 +74,255 @@ if _G.COLONY_EMBED then
 end
 
 if not _G.COLONY_EMBED then
-  -- This is temporary until we have proper compilation in C.
-  colony._load = function (file)
-    -- Compile JS script before running.
-    local status
-    if jit == nil then
-      status = os.execute(_G.COLONY_COMPILER_PATH .. ' -m ' .. file .. ' > /tmp/colonyunique')
+  -- Compiled output is cached on disk, keyed by the module's path and source
+  -- hash, the compiler version, and the Lua VM, so unchanged modules skip the
+  -- compiler entirely.
+  -- Set COLONY_CACHE_DIR to move the cache, or to an empty string to disable it.
+  local function compiler_version ()
+    local dir = string.match(_G.COLONY_COMPILER_PATH or '', '^(.*)/bin/[^/]*$')
+    local file = dir and io.open(dir .. '/package.json', 'r')
+    if not file then
+      return 'unknown'
+    end
+    local pkg = file:read('*all')
+    file:close()
+    return string.match(pkg, '"version"%s-:%s-"([^"]+)"') or 'unknown'
+  end
+
+  local cache_dir = os.getenv('COLONY_CACHE_DIR')
+  if cache_dir == nil then
+    local base = os.getenv('XDG_CACHE_HOME')
+    if base == nil or base == '' then
+      base = (os.getenv('HOME') or '/tmp') .. '/.cache'
+    end
+    cache_dir = base .. '/colony'
+  end
+  local cache_ready = false
+  -- With the compiler server available, every module is compiled by it, one
+  -- at a time or in batches, so cached output never mixes the two compilers.
+  local compiler_server = _G.COLONY_COMPILER_SERVER_PATH or ''
+  local cache_salt = compiler_version() .. '-' .. (jit and jit.version or _VERSION)
+    .. (compiler_server ~= '' and '-server' or '-cli')
+
+  local function shell_quote (str)
+    return "'" .. string.gsub(str, "'", "'\\''") .. "'"
+  end
+
+  local function read_all (path)
+    local file = io.open(path, 'rb')
+    if not file then
+      return nil
+    end
+    local data = file:read('*all')
+    file:close()
+    return data
+  end
+
+  -- Each entry starts with a line holding the source length and a second hash
+  -- of the source, which is checked on load, so a key collision recompiles
+  -- rather than loading another module's output.
+  local function cache_check (source)
+    return #source .. ' ' .. tm.hash_fnv1a(source .. '\0' .. cache_salt)
+  end
+
+  local function cache_read (path, source)
+    local output = read_all(path)
+    local nl = output and string.find(output, '\n', 1, true)
+    if not nl or string.sub(output, 1, nl - 1) ~= cache_check(source) then
+      return nil
+    end
+    return string.sub(output, nl + 1)
+  end
+
+  local function cache_has (path, source)
+    local file = io.open(path, 'rb')
+    if not file then
+      return false
+    end
+    local header = file:read('*l')
+    file:close()
+    return header == cache_check(source)
+  end
+
+  local function cache_store (path, source, output)
+    if not cache_ready then
+      os.execute('mkdir -p ' .. shell_quote(cache_dir))
+      cache_ready = true
+    end
+    -- Write to a unique name and rename, so concurrent runs never observe a
+    -- partially written entry.
+    local tmp = path .. '.' .. tm.hash_fnv1a(tostring({}) .. tm.timestamp() .. os.clock()) .. '.tmp'
+    local file = io.open(tmp, 'wb')
+    if file then
+      file:write(cache_check(source), '\n', output)
+      file:close()
+      if not os.rename(tmp, path) then
+        os.remove(tmp)
+      end
+    end
+  end
+
+  local function compile (file)
+    local command
+    if compiler_server ~= '' then
+      command = shell_quote(compiler_server) .. (jit and ' jit ' or ' lua ')
     else
-      status = os.execute(_G.COLONY_COMPILER_PATH .. ' -l ' .. file .. ' > /tmp/colonyunique')
+      command = _G.COLONY_COMPILER_PATH .. (jit == nil and ' -m ' or ' -l ')
     end
+    local out = os.tmpname()
+    local status = os.execute(command .. shell_quote(file) .. ' > ' .. out)
     if status ~= 0 then
+      os.remove(out)
       os.exit(status)
     end
-    local file = io.open('/tmp/colonyunique', 'r')
-    local output = file:read('*all')
-    file:close()
+    local output = read_all(out)
+    os.remove(out)
+    return output
+  end
+
+  -- A single compiler process is started on the first cache miss and kept
+  -- for the life of the runtime. Requests go over its stdin; responses come
+  -- back through a fifo, since io.popen is one-way.
+  local server, server_out, server_failed = nil, nil, false
+
+  local function server_stop ()
+    server:close()
+    server_out:close()
+    server, server_out, server_failed = nil, nil, true
+  end
+
+  local function server_start ()
+    if server or server_failed then
+      return server ~= nil
+    end
+    server_failed = true
+    if compiler_server == '' then
+      return false
+    end
+    local fifo = os.tmpname()
+    os.remove(fifo)
+    if os.execute('mkfifo -m 600 ' .. shell_quote(fifo)) ~= 0 then
+      return false
+    end
+    server = io.popen(shell_quote(compiler_server) .. ' > ' .. shell_quote(fifo), 'w')
+    server_out = server and io.open(fifo, 'rb')
+    os.remove(fifo)
+    if not server_out then
+      server = nil
+      return false
+    end
+    -- Wait for the server to come up before writing to it.
+    if server_out:read('*l') ~= 'ready' then
+      server_stop()
+      return false
+    end
+    server_failed = false
+    return true
+  end
+
+  local function server_deps (file)
+    server:write('deps ', file, '\n')
+    server:flush()
+    local count = tonumber(server_out:read('*l'))
+    if count == nil then
+      server_stop()
+      return nil
+    end
+    local files = {}
+    for i = 1, count do
+      files[i] = server_out:read('*l')
+    end
+    return files
+  end
+
+  local function server_compile (files)
+    server:write('compile ', jit and 'jit' or 'lua', ' ', #files, '\n', table.concat(files, '\n'), '\n')
+    server:flush()
+    local outputs = {}
+    for i = 1, #files do
+      local status, len = string.match(server_out:read('*l') or '', '^(%a+) (%d+)$')
+      if status == nil then
+        server_stop()
+        return nil
+      end
+      local output = server_out:read(tonumber(len)) or ''
+      -- Files that fail are left uncompiled. If one is actually required,
+      -- loading it compiles it directly, which reports the error.
+      if status == 'ok' then
+        outputs[i] = output
+      end
+    end
+    return outputs
+  end
+
+  -- Bytecode is named after the module's path, so identical sources at
+  -- different paths get separate entries. Paths are made absolute, as the
+  -- compiler server reports them.
+  local function absolute_path (file)
+    if string.sub(file, 1, 1) ~= '/' then
+      file = tm.cwd() .. '/' .. file
+    end
+    local parts = {}
+    for part in string.gmatch(file, '[^/]+') do
+      if part == '..' then
+        parts[#parts] = nil
+      elseif part ~= '.' then
+        parts[#parts + 1] = part
+      end
+    end
+    return '/' .. table.concat(parts, '/')
+  end
+
+  local function cache_key (file, source)
+    return tm.hash_fnv1a(cache_salt .. '\0' .. absolute_path(file) .. '\0' .. source) .. '-' .. #source
+  end
+
+  -- Compiles every uncached module reachable from file in one batch, so the
+  -- rest of the dependency graph is warm before it is required.
+  local function precompile (file)
+    local files = server_deps(file)
+    if files == nil then
+      return
+    end
+    local missing, paths, sources = {}, {}, {}
+    for _, dep in ipairs(files) do
+      local source = read_all(dep)
+      if source then
+        local path = cache_dir .. '/' .. cache_key(dep, source) .. '.luac'
+        if not cache_has(path, source) then
+          missing[#missing + 1] = dep
+          paths[#missing] = path
+          sources[#missing] = source
+        end
+      end
+    end
+    if #missing > 0 then
+      local outputs = server_compile(missing)
+      for i = 1, outputs and #missing or 0 do
+        if outputs[i] then
+          cache_store(paths[i], sources[i], outputs[i])
+        end
+      end
+    end
+  end
+
+  colony._load = function (file)
+    if cache_dir == '' then
+      return compile(file)
+    end
+
+    local source = read_all(file) or ''
+    local path = cache_dir .. '/' .. cache_key(file, source) .. '.luac'
+
+    local output = cache_read(path, source)
+    if output == nil and server_start() then
+      precompile(file)
+      output = cache_read(path, source)
+    end
+    if output == nil then
+      output = compile(file)
+      cache_store(path, source, output)
+    end
     return output
   end
 end
@@ -128,7 +362,9 @@ do
     end
     return js_arr({[0]=math.floor(nanos / 1e9), nanos % 1e9}, 2)
   end
-  global.process.nextTick = global.setImmediate
+  global.process.nextTick = function (this, fn, ...)
+    tm.next_tick(wrap_timer_cb(fn, ...))
+  end
 
   -- DEPLOY_TIME workaround for setting environmental time
 
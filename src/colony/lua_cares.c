@@ -16,6 +16,9 @@
 #include <unistd.h>
 #include <ares.h>
 #include <tm.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include "colony.h"
 #ifndef COLONY_EMBED
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -26,118 +29,326 @@
 
 #define INET6_ADDRSTRLEN 46
 
-uint8_t ipaddr[4] = { 0 };
- 
-static void
-state_cb(void *data, int s, int read, int write)
+// Addresses reported per lookup.
+#define DNS_MAX_ADDRS 8
+
+#define DNS_CLASS_IN 1
+#define DNS_TYPE_A 1
+
+/**
+ * Channel
+ *
+ * One c-ares channel is shared by all lookups. Its sockets are watched by the
+ * event loop and its retransmits are driven by a timer, so nothing blocks
+ * while a query is outstanding. Sockets the event loop can't watch are polled
+ * from that timer instead.
+ */
+
+// Interval at which sockets that couldn't be registered are polled.
+#define DNS_POLL_US 10000
+
+static ares_channel dns_channel;
+static bool dns_channel_open = false;
+static uint32_t dns_channel_server = 0;
+static unsigned dns_timer = 0;
+
+/// A c-ares socket registered with the event loop. `watch` must be the first
+/// member so that the event passed to the callback can be cast back.
+typedef struct dns_watch {
+    tm_fd_watch watch;
+    struct dns_watch* next;
+    bool stopped; // Set when closed while the event is still queued
+    bool polled; // Set when the event loop couldn't watch the socket
+} dns_watch_t;
+
+static dns_watch_t* dns_watches = NULL;
+
+/// A pending lookup. Results are delivered through `event` rather than from
+/// inside c-ares, so the callback always runs from the event loop. `ttl` is
+/// the shortest TTL of the answers, or 0 for answers that weren't from DNS.
+typedef struct dns_query {
+    tm_event event;
+    int lua_cb;
+    int status;
+    int ttl;
+    size_t naddrs;
+    uint32_t addrs[DNS_MAX_ADDRS];
+} dns_query_t;
+
+static void dns_schedule ();
+
+static void dns_watch_cb (tm_event* event)
 {
-    (void) data;
-    (void) s;
-    (void) read;
-    (void) write;
-    // printf("Change state fd %d read:%d write:%d\n", s, read, write);
+    dns_watch_t* w = (dns_watch_t*) event;
+    if (w->stopped) {
+        free(w);
+        return;
+    }
+
+    // c-ares may close this socket (and free the watch) while processing.
+    ares_socket_t fd = w->watch.fd;
+    unsigned ready = w->watch.ready;
+    ares_process_fd(dns_channel,
+        (ready & TM_FD_READABLE) ? fd : ARES_SOCKET_BAD,
+        (ready & TM_FD_WRITABLE) ? fd : ARES_SOCKET_BAD);
+    dns_schedule();
 }
- 
- 
-static void
-callback(void *arg, int status, int timeouts, struct hostent *host)
+
+static void dns_sock_state_cb (void* data, ares_socket_t s, int read, int write)
 {
-    (void) arg;
-    (void) timeouts;
+    (void) data;
 
-    if(!host || status != ARES_SUCCESS){
-        printf("Failed to lookup %s\n", ares_strerror(status));
-        return;
+    dns_watch_t** p = &dns_watches;
+    while (*p && (*p)->watch.fd != s) {
+        p = &(*p)->next;
     }
- 
-    // printf("Found address name %s\n", host->h_name);
-    int i = 0;
- 
-    for (i = 0; host->h_addr_list[i]; ++i) {
-        const uint8_t *ap = (const uint8_t *)&(*(struct in_addr *) host->h_addr_list[i]).s_addr;
-        // printf("%d.%d.%d.%d\n", ap[0], ap[1], ap[2], ap[3]);
-        ipaddr[0] = ap[0];
-        ipaddr[1] = ap[1];
-        ipaddr[2] = ap[2];
-        ipaddr[3] = ap[3];
-        break;
+    dns_watch_t* w = *p;
+
+    if (read || write) {
+        if (w == NULL) {
+            w = calloc(1, sizeof(dns_watch_t));
+            if (w == NULL) {
+                return;
+            }
+            w->watch.event.callback = dns_watch_cb;
+            w->watch.fd = s;
+            w->next = dns_watches;
+            dns_watches = w;
+        }
+        // c-ares sockets are non-blocking, so polling one that isn't ready is harmless.
+        w->polled = tm_fd_register(&w->watch, s, (read ? TM_FD_READABLE : 0) | (write ? TM_FD_WRITABLE : 0)) != 0;
+        if (w->polled) {
+            TM_DEBUG("dns: polling socket %d, which could not be watched", (int) s);
+        }
+    } else if (w != NULL) {
+        *p = w->next;
+        tm_fd_unregister(&w->watch);
+        if (w->watch.event.pending) {
+            w->stopped = true;
+        } else {
+            free(w);
+        }
     }
 }
- 
-static void
-wait_ares(ares_channel channel)
+
+// Timer callback: polls unwatched sockets, and lets c-ares retransmit or
+// expire queries that timed out.
+static int dns_timeout (lua_State* L)
 {
-    for(;;){
-        struct timeval *tvp, tv;
-        fd_set read_fds, write_fds, err_fds;
-        int nfds;
- 
-        FD_ZERO(&read_fds);
-        FD_ZERO(&write_fds);
-        FD_ZERO(&err_fds);
-        nfds = ares_fds(channel, &read_fds, &write_fds);
-        if (nfds == 0){
-            return;
-        }
-        memcpy(&err_fds, &read_fds, sizeof(read_fds));
-        tvp = ares_timeout(channel, NULL, &tv);
-        select(nfds, &read_fds, &write_fds, &err_fds, tvp);
-        for (int i = 0; i < nfds; i++) {
-            if (FD_ISSET(i, &err_fds)) {
-                return;
-            }
+    (void) L;
+    dns_timer = 0;
+
+    // c-ares may close sockets (and free their watches) while processing.
+    ares_socket_t polled[ARES_GETSOCK_MAXNUM];
+    size_t npolled = 0;
+    for (dns_watch_t* w = dns_watches; w != NULL && npolled < ARES_GETSOCK_MAXNUM; w = w->next) {
+        if (w->polled) {
+            polled[npolled++] = w->watch.fd;
         }
-        ares_process(channel, &read_fds, &write_fds);
     }
+    for (size_t i = 0; i < npolled; i++) {
+        ares_process_fd(dns_channel, polled[i], polled[i]);
+    }
+    ares_process_fd(dns_channel, ARES_SOCKET_BAD, ARES_SOCKET_BAD);
+    dns_schedule();
+    return 0;
 }
 
-// Bad synchronous gethostbyname demo
-uint32_t tm__sync_gethostbyname (const char *domain)
+// Sets the timer for the next c-ares timeout, if any query is pending, or
+// sooner if a socket has to be polled.
+static void dns_schedule ()
 {
-    ares_channel channel;
-    int status;
-    struct ares_options options;
-    int optmask = 0;
+    if (dns_timer != 0) {
+        tm_cleartimeout(dns_timer);
+        dns_timer = 0;
+    }
+    if (!dns_channel_open) {
+        return;
+    }
 
-    ipaddr[0] = ipaddr[1] = ipaddr[2] = ipaddr[3] = 0;
+    bool polling = false;
+    for (dns_watch_t* w = dns_watches; w != NULL; w = w->next) {
+        polling = polling || w->polled;
+    }
 
-    struct in_addr ns1;
+    struct timeval poll_tv = { 0, DNS_POLL_US };
+    struct timeval tv;
+    if (ares_timeout(dns_channel, polling ? &poll_tv : NULL, &tv) == NULL) {
+        return;
+    }
+    lua_pushcfunction(tm_lua_state, dns_timeout);
+    int ref = luaL_ref(tm_lua_state, LUA_REGISTRYINDEX);
+    dns_timer = tm_settimeout(tv.tv_sec * 1000000 + tv.tv_usec, false, ref);
+}
 
-    // get the dns server
+// Opens the channel, or reopens it if the DNS server has changed.
+static int dns_channel_init ()
+{
     uint32_t ip_dns = tm_net_dnsserver();
     if (ip_dns == 0) {
         // error not connected
-        return 1;
+        return -1;
+    }
+    if (dns_channel_open && ip_dns == dns_channel_server) {
+        return 0;
+    }
+    if (dns_channel_open) {
+        // Pending lookups fail with ARES_EDESTRUCTION.
+        ares_destroy(dns_channel);
+        dns_channel_open = false;
+    } else {
+        int status = ares_library_init(ARES_LIB_INIT_ALL);
+        if (status != ARES_SUCCESS) {
+            TM_DEBUG("ares_library_init: %s", ares_strerror(status));
+            return -1;
+        }
     }
+
     char str_dns[16] = {0}; // length of 255.255.255.255 + 1
     sprintf(str_dns, "%d.%d.%d.%d", (uint8_t)TM_BYTE(ip_dns, 3), (uint8_t)TM_BYTE(ip_dns, 2), (uint8_t)TM_BYTE(ip_dns, 1), (uint8_t)TM_BYTE(ip_dns, 0));
-    
+    struct in_addr ns1;
     inet_aton(str_dns, &ns1);
- 
-    status = ares_library_init(ARES_LIB_INIT_ALL);
-    if (status != ARES_SUCCESS){
-        printf("ares_library_init: %s\n", ares_strerror(status));
-        return 1;
-    }
+
+    struct ares_options options;
+    int optmask = 0;
     options.servers = &ns1;
     options.nservers = 1;
     optmask |= ARES_OPT_SERVERS;
-    options.sock_state_cb = state_cb;
-    // options.sock_state_cb_data;
+    // CC3000 can flake with cares. Three time's the charm.
+    options.tries = 3;
+    optmask |= ARES_OPT_TRIES;
+    options.sock_state_cb = dns_sock_state_cb;
+    options.sock_state_cb_data = NULL;
     optmask |= ARES_OPT_SOCK_STATE_CB;
- 
-    status = ares_init_options(&channel, &options, optmask);
-    if(status != ARES_SUCCESS) {
-        printf("ares_init_options: %s\n", ares_strerror(status));
-        return 1;
-    }
- 
-    ares_gethostbyname(channel, domain, AF_INET, callback, NULL);
-    wait_ares(channel);
-    ares_destroy(channel);
-    ares_library_cleanup();
-    // printf("fin\n");
-    // printf("result => %d.%d.%d.%d\n", ipaddr[0], ipaddr[1], ipaddr[2], ipaddr[3]);
-
-    return (ipaddr[0] << 24) | (ipaddr[1] << 16) | (ipaddr[2] << 8) | ipaddr[3];
+
+    int status = ares_init_options(&dns_channel, &options, optmask);
+    if (status != ARES_SUCCESS) {
+        TM_DEBUG("ares_init_options: %s", ares_strerror(status));
+        return -1;
+    }
+    dns_channel_open = true;
+    dns_channel_server = ip_dns;
+    return 0;
+}
+
+/**
+ * Lookups
+ */
+
+// Node's names for c-ares errors.
+static const char* dns_error_code (int status)
+{
+    switch (status) {
+        case ARES_ENODATA: return "ENODATA";
+        case ARES_EFORMERR: return "EFORMERR";
+        case ARES_ESERVFAIL: return "ESERVFAIL";
+        case ARES_ENOTFOUND: return "ENOTFOUND";
+        case ARES_ENOTIMP: return "ENOTIMP";
+        case ARES_EREFUSED: return "EREFUSED";
+        case ARES_EBADNAME: return "EBADNAME";
+        case ARES_ECONNREFUSED: return "ECONNREFUSED";
+        case ARES_ETIMEOUT: return "ETIMEOUT";
+        case ARES_ENOMEM: return "ENOMEM";
+        case ARES_EDESTRUCTION: return "EDESTRUCTION";
+        case ARES_ECANCELLED: return "ECANCELLED";
+        default: return "EBADRESP";
+    }
+}
+
+static void dns_query_cb (tm_event* event)
+{
+    dns_query_t* q = (dns_query_t*) event;
+    lua_State* L = tm_lua_state;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, q->lua_cb);
+    luaL_unref(L, LUA_REGISTRYINDEX, q->lua_cb);
+    lua_getfield(L, LUA_GLOBALSINDEX, "global");
+    if (q->status == ARES_SUCCESS) {
+        lua_pushnil(L);
+    } else {
+        lua_pushstring(L, dns_error_code(q->status));
+    }
+    colony_createarray(L, q->naddrs);
+    for (size_t i = 0; i < q->naddrs; i++) {
+        lua_pushnumber(L, q->addrs[i]);
+        lua_rawseti(L, -2, i);
+    }
+    lua_pushnumber(L, q->ttl);
+
+    // Clean up before calling lua, as it can setjmp.
+    tm_event_unref(&q->event);
+    free(q);
+    tm_checked_call(L, 4);
+}
+
+static void dns_query_addr (dns_query_t* q, const struct in_addr* addr)
+{
+    const uint8_t *ap = (const uint8_t *) &addr->s_addr;
+    q->addrs[q->naddrs++] = ((uint32_t) ap[0] << 24) | (ap[1] << 16) | (ap[2] << 8) | ap[3];
+}
+
+// Answers from the A records of a reply, which carry their TTLs.
+static void dns_search_cb (void* arg, int status, int timeouts, unsigned char* abuf, int alen)
+{
+    (void) timeouts;
+    dns_query_t* q = (dns_query_t*) arg;
+
+    q->status = status;
+    if (status == ARES_SUCCESS) {
+        struct ares_addrttl addrttls[DNS_MAX_ADDRS];
+        int naddrttls = DNS_MAX_ADDRS;
+        q->status = ares_parse_a_reply(abuf, alen, NULL, addrttls, &naddrttls);
+        if (q->status == ARES_SUCCESS && naddrttls == 0) {
+            q->status = ARES_ENODATA;
+        }
+        for (int i = 0; q->status == ARES_SUCCESS && i < naddrttls; i++) {
+            dns_query_addr(q, &addrttls[i].ipaddr);
+            if (i == 0 || addrttls[i].ttl < q->ttl) {
+                q->ttl = addrttls[i].ttl;
+            }
+        }
+    }
+    tm_event_trigger(&q->event);
+}
+
+int tm_dns_lookup (const char* domain, int lua_cb)
+{
+    dns_query_t* q = calloc(1, sizeof(dns_query_t));
+    if (q == NULL) {
+        luaL_unref(tm_lua_state, LUA_REGISTRYINDEX, lua_cb);
+        return -1;
+    }
+    q->event.callback = dns_query_cb;
+    q->lua_cb = lua_cb;
+
+    // Addresses need no server.
+    struct in_addr addr;
+    if (inet_aton(domain, &addr)) {
+        dns_query_addr(q, &addr);
+        tm_event_ref(&q->event);
+        tm_event_trigger(&q->event);
+        return 0;
+    }
+
+    if (dns_channel_init() != 0) {
+        luaL_unref(tm_lua_state, LUA_REGISTRYINDEX, lua_cb);
+        free(q);
+        return -1;
+    }
+    tm_event_ref(&q->event);
+
+    // Names from the hosts file, where there is one, are answered directly.
+    struct hostent* host = NULL;
+    if (ares_gethostbyname_file(dns_channel, domain, AF_INET, &host) == ARES_SUCCESS) {
+        for (int i = 0; host->h_addr_list[i] && q->naddrs < DNS_MAX_ADDRS; ++i) {
+            dns_query_addr(q, (struct in_addr *) host->h_addr_list[i]);
+        }
+        ares_free_hostent(host);
+        tm_event_trigger(&q->event);
+        return 0;
+    }
+
+    ares_search(dns_channel, domain, DNS_CLASS_IN, DNS_TYPE_A, dns_search_cb, q);
+    dns_schedule();
+    return 0;
 }
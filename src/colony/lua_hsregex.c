@@ -12,6 +12,7 @@
 #include <lualib.h>
 
 #include <ctype.h>
+#include <limits.h>
 
 #include "colony.h"
 #include "regalone.h"
@@ -44,26 +45,211 @@ static chr* toregexstr (const char *input, size_t input_len, size_t* output_len)
   return _toregexstr(input, input_len, output, output_len);
 }
 
-static const chr* lua_toregexstr (lua_State* L, int pos, size_t* buflen)
+
+/**
+ * Compiled regex cache
+ */
+
+// Compiled regexes are shared by every RegExp with the same pattern and
+// flags. The registry table HSREGEX_CACHE holds the HSREGEX_CACHE_SIZE most
+// recently used (with the count at [1]); a regex is freed once neither the
+// cache nor any RegExp refers to it.
+#define HSREGEX_CACHE "hsregex_cache"
+#define HSREGEX_CACHE_SIZE 64
+#define HSREGEX_MT "hsregex_t"
+
+typedef struct {
+  regex_t re;           // first, so that the userdata is a regex_t*
+  int flags;
+  int compiled;
+  unsigned long used;
+  chr patt[1];          // the pattern lives as long as the regex
+} hsregex_entry_t;
+
+static unsigned long hsregex_clock = 0;
+
+static int l_hsregex_gc (lua_State* L)
+{
+  hsregex_entry_t* entry = (hsregex_entry_t*) lua_touserdata(L, 1);
+  if (entry->compiled) {
+    regfree(&entry->re);
+    entry->compiled = 0;
+  }
+  return 0;
+}
+
+// Pushes the cache table, creating it on first use.
+static void hsregex_cache (lua_State* L)
+{
+  lua_getfield(L, LUA_REGISTRYINDEX, HSREGEX_CACHE);
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    lua_createtable(L, 1, HSREGEX_CACHE_SIZE);
+    lua_pushnumber(L, 0);
+    lua_rawseti(L, -2, 1);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, HSREGEX_CACHE);
+  }
+}
+
+// Drops the least recently used regex from the cache.
+static void hsregex_evict (lua_State* L, int cache)
+{
+  unsigned long oldest = ULONG_MAX;
+  lua_pushnil(L);                           // (lru)
+  int lru = lua_gettop(L);
+
+  lua_pushnil(L);
+  while (lua_next(L, cache) != 0) {         // (lru, key, entry)
+    if (lua_type(L, -2) == LUA_TSTRING) {
+      hsregex_entry_t* entry = (hsregex_entry_t*) lua_touserdata(L, -1);
+      if (entry->used < oldest) {
+        oldest = entry->used;
+        lua_pushvalue(L, -2);
+        lua_replace(L, lru);
+      }
+    }
+    lua_pop(L, 1);                          // (lru, key)
+  }
+
+  if (lua_isnil(L, lru)) {
+    lua_pop(L, 1);
+    return;
+  }
+  lua_pushnil(L);
+  lua_rawset(L, cache);                     // ()
+}
+
+// regex_compile(pattern, flags) -> regex, nsub | nil, error
+static int l_regex_compile (lua_State* L)
 {
   size_t patt_len = 0;
-  const char *patt = lua_tolstring(L, pos, &patt_len);
-  chr *mbpatt = (chr *) lua_newuserdata(L, (patt_len+1) * sizeof(chr));
-  return _toregexstr(patt, patt_len, mbpatt, buflen);
+  const char* patt = luaL_checklstring(L, 1, &patt_len);
+  int flags = (int) lua_tonumber(L, 2);
+  lua_settop(L, 2);
+
+  hsregex_cache(L);                         // (cache)
+  int cache = lua_gettop(L);
+  lua_pushvalue(L, 1);
+  lua_rawget(L, cache);                     // (cache, entry)
+  hsregex_entry_t* entry = (hsregex_entry_t*) lua_touserdata(L, -1);
+  if (entry != NULL && entry->flags == flags) {
+    entry->used = ++hsregex_clock;
+    lua_pushnumber(L, entry->re.re_nsub);
+    return 2;
+  }
+  int replacing = entry != NULL;
+  lua_pop(L, 1);                            // (cache)
+
+  entry = (hsregex_entry_t*) lua_newuserdata(L, sizeof(hsregex_entry_t) + patt_len * sizeof(chr));
+  memset(entry, 0, sizeof(hsregex_entry_t));
+  if (luaL_newmetatable(L, HSREGEX_MT)) {
+    lua_pushcfunction(L, l_hsregex_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);                  // (cache, entry)
+
+  size_t wpatt_len = 0;
+  _toregexstr(patt, patt_len, entry->patt, &wpatt_len);
+  int rc = re_comp(&entry->re, entry->patt, wpatt_len, flags);
+  if (rc != 0) {
+    lua_pushnil(L);
+    lua_pushnumber(L, rc);
+    return 2;
+  }
+  entry->compiled = 1;
+  entry->flags = flags;
+  entry->used = ++hsregex_clock;
+
+  lua_rawgeti(L, cache, 1);
+  size_t count = (size_t) lua_tonumber(L, -1);
+  lua_pop(L, 1);
+  if (!replacing) {
+    if (count >= HSREGEX_CACHE_SIZE) {
+      hsregex_evict(L, cache);
+    } else {
+      count++;
+    }
+  }
+  lua_pushnumber(L, count);
+  lua_rawseti(L, cache, 1);
+
+  lua_pushvalue(L, 1);
+  lua_pushvalue(L, -2);
+  lua_rawset(L, cache);                     // (cache, entry)
+
+  lua_pushnumber(L, entry->re.re_nsub);
+  return 2;
 }
 
 
 /**
- * Regex bindings
+ * Subject cache
  */
 
-static int l_regex_create (lua_State* L)
+// The wide copy of the most recent subject is kept between calls, so that
+// repeated matches against one string convert it once. The subject is
+// referenced from the registry while cached, so its address can't be
+// reused by another string. The one-shot functions (match_all, replace and
+// split) walk the whole subject in one call, so they release subjects longer
+// than HSREGEX_SUBJECT_KEEP when they return; re_exec keeps them, since a
+// global exec loop calls it once per match.
+#define HSREGEX_SUBJECT "hsregex_subject"
+#define HSREGEX_SUBJECT_KEEP 16384
+
+static const char* subject_str = NULL;
+static size_t subject_len = 0;
+static chr* subject_w = NULL;
+static size_t subject_wlen = 0;
+static size_t subject_cap = 0;
+
+static const chr* hsregex_subject (lua_State* L, int index, const char** input, size_t* input_len, size_t* wlen)
 {
-  regex_t* cre = (regex_t*) lua_newuserdata(L, sizeof(regex_t));
-  memset(cre, 0, sizeof(regex_t));
-  return 1;
+  *input = lua_tolstring(L, index, input_len);
+  if (*input != subject_str || *input_len != subject_len) {
+    subject_str = NULL;
+
+    // Grow to fit, or give back a large buffer once subjects are small.
+    size_t cap = *input_len + 1;
+    if (cap > subject_cap || (subject_cap > HSREGEX_SUBJECT_KEEP && cap < subject_cap / 4)) {
+      chr* w = (chr*) realloc(subject_w, cap * sizeof(chr));
+      if (w == NULL) {
+        luaL_error(L, "regex subject out of memory");
+      }
+      subject_w = w;
+      subject_cap = cap;
+    }
+    _toregexstr(*input, *input_len, subject_w, &subject_wlen);
+
+    lua_pushvalue(L, index);
+    lua_setfield(L, LUA_REGISTRYINDEX, HSREGEX_SUBJECT);
+    subject_str = *input;
+    subject_len = *input_len;
+  }
+  *wlen = subject_wlen;
+  return subject_w;
+}
+
+// Called by the one-shot functions once they are done with the subject.
+static void hsregex_subject_release (lua_State* L)
+{
+  if (subject_cap <= HSREGEX_SUBJECT_KEEP) {
+    return;
+  }
+  free(subject_w);
+  subject_w = NULL;
+  subject_wlen = subject_cap = 0;
+  subject_str = NULL;
+  subject_len = 0;
+  lua_pushnil(L);
+  lua_setfield(L, LUA_REGISTRYINDEX, HSREGEX_SUBJECT);
 }
 
+
+/**
+ * Regex bindings
+ */
+
 static int l_regex_nsub (lua_State* L)
 {
   regex_t* cre = (regex_t*) lua_touserdata(L, 1);
@@ -99,36 +285,72 @@ static int l_regmatch_eo (lua_State* L)
   return 1;
 }
 
-static int l_re_comp (lua_State* L)
+// re_exec(regex, subject, start, nmatch, pmatch, flags) -> rc
+// Matching begins at offset start; offsets in pmatch are from the beginning
+// of the subject.
+static int l_re_exec (lua_State* L)
 {
-  size_t pattlen;
   regex_t* cre = (regex_t*) lua_touserdata(L, 1);
-  int flags = (int) lua_tonumber(L, 3);
+  size_t start = (size_t) lua_tonumber(L, 3);
+  int pmatchlen = (int) lua_tonumber(L, 4);
+  regmatch_t* pmatch = (regmatch_t*) lua_touserdata(L, 5);
+  int flags = (int) lua_tonumber(L, 6);
+
+  const char* input;
+  size_t input_len, data_len;
+  const chr* data = hsregex_subject(L, 2, &input, &input_len, &data_len);
+  if (start > data_len) {
+    lua_pushnumber(L, REG_NOMATCH);
+    return 1;
+  }
+  if (start > 0) {
+    flags |= REG_NOTBOL;
+  }
 
-  const wchar_t* patt = lua_toregexstr(L, 2, &pattlen);
-  int rc = re_comp(cre, patt, pattlen, flags);
+  int rc = re_exec(cre, &data[start], data_len - start, NULL, pmatchlen, pmatch, flags);
+  if (rc == 0 && start > 0) {
+    for (int i = 0; i < pmatchlen; i++) {
+      if (pmatch[i].rm_so > -1) {
+        pmatch[i].rm_so += start;
+        pmatch[i].rm_eo += start;
+      }
+    }
+  }
 
   lua_pushnumber(L, rc);
-  return 2;
+  return 1;
 }
 
-static int l_re_exec (lua_State* L)
+// regex_match_all(regex, subject) -> matches, count
+// Every match of regex in subject, as for a global String#match.
+static int l_regex_match_all (lua_State* L)
 {
   regex_t* cre = (regex_t*) lua_touserdata(L, 1);
-  // ignore 3
-  int pmatchlen = (int) lua_tonumber(L, 4);
-  regmatch_t* pmatch = (regmatch_t*) lua_touserdata(L, 5);
-  int flags = (int) lua_tonumber(L, 6);
 
-  size_t input_len;
-  const char* input = lua_tolstring(L, 2, &input_len);
-  size_t data_len;
-  chr* data = toregexstr(input, input_len, &data_len);
-  int rc = re_exec(cre, data, data_len, NULL, pmatchlen, pmatch, flags);
-  
-  free(data);
-  lua_pushnumber(L, rc);
-  return 1;
+  const char* input;
+  size_t input_len, data_len;
+  const chr* data = hsregex_subject(L, 2, &input, &input_len, &data_len);
+
+  lua_createtable(L, 0, 0);
+  size_t count = 0;
+  size_t start = 0;
+  regmatch_t pmatch[1];
+  while (start <= data_len) {
+    int rc = re_exec(cre, &data[start], data_len - start, NULL, 1, pmatch, start > 0 ? REG_NOTBOL : 0);
+    if (rc != 0 || pmatch[0].rm_so < 0) {
+      break;
+    }
+    size_t so = start + pmatch[0].rm_so, eo = start + pmatch[0].rm_eo;
+    lua_pushlstring(L, &input[so], eo - so);
+    lua_rawseti(L, -2, count++);
+
+    // An empty match moves on by one, so it isn't found again.
+    start = eo > so ? eo : eo + 1;
+  }
+  hsregex_subject_release(L);
+
+  lua_pushnumber(L, count);
+  return 2;
 }
 
 static int l_regerror (lua_State* L)
@@ -142,12 +364,6 @@ static int l_regerror (lua_State* L)
   return 1;
 }
 
-static int l_regfree (lua_State* L)
-{
-  regfree(lua_touserdata(L, 1));
-  return 0;
-}
-
 typedef struct {
   uint8_t* string;
   size_t len;
@@ -203,13 +419,21 @@ static int l_regex_replace (lua_State *L)
   size_t pmatch_len = cre->re_nsub + 1;
   regmatch_t* pmatch = (regmatch_t*) calloc(1, sizeof(regmatch_t) * (pmatch_len));
 
-  size_t w_input_len = 0;
-  chr* orig_w_input = toregexstr(input, input_len, &w_input_len);
-  chr* w_input = orig_w_input;
-
   int nullmatch_flag = 0;
   int isfn_flag = lua_isfunction(L, 3);
 
+  // A replacer function may run other regexes, which would replace the
+  // cached subject, so it gets a copy of its own.
+  size_t w_input_len = 0;
+  chr* orig_w_input = NULL;
+  const chr* w_input;
+  if (isfn_flag) {
+    orig_w_input = toregexstr(input, input_len, &w_input_len);
+    w_input = orig_w_input;
+  } else {
+    w_input = hsregex_subject(L, 1, &input, &input_len, &w_input_len);
+  }
+
   // Replace with strings.
   size_t out_len = 0, orig_out_len = 0;
   const char* out = NULL;
@@ -313,6 +537,9 @@ static int l_regex_replace (lua_State *L)
   free(b.string);
   free(orig_w_input);
   free(pmatch);
+  if (!isfn_flag) {
+    hsregex_subject_release(L);
+  }
 
   return 1;
 }
@@ -331,8 +558,7 @@ static int l_regex_split (lua_State *L)
   regmatch_t* pmatch = (regmatch_t*) calloc(1, sizeof(regmatch_t) * (pmatch_len));
 
   size_t w_input_len = 0;
-  chr* orig_w_input = toregexstr(input, input_len, &w_input_len);
-  chr* w_input = orig_w_input;
+  const chr* w_input = hsregex_subject(L, 1, &input, &input_len, &w_input_len);
 
   lua_createtable(L, 0, 0);
 
@@ -356,8 +582,8 @@ static int l_regex_split (lua_State *L)
     input_len -= pmatch[0].rm_eo;
   }
 
-  free(orig_w_input);
   free(pmatch);
+  hsregex_subject_release(L);
   lua_pushnumber(L, idx);
 
   return 2;
@@ -375,18 +601,17 @@ LUALIB_API int luaopen_hsregex (lua_State *L)
   lua_newtable (L);
   luaL_register(L, NULL, (luaL_reg[]) {
 
-    { "regex_create", l_regex_create },
+    { "regex_compile", l_regex_compile },
     { "regex_nsub", l_regex_nsub },
     { "regmatch_create", l_regmatch_create },
     { "regmatch_so", l_regmatch_so },
     { "regmatch_eo", l_regmatch_eo },
-    { "re_comp", l_re_comp },
     { "re_exec", l_re_exec },
     { "regerror", l_regerror },
-    { "regfree", l_regfree },
 
     { "regex_split", l_regex_split },
     { "regex_replace", l_regex_replace },
+    { "regex_match_all", l_regex_match_all },
 
     { NULL, NULL }
   });
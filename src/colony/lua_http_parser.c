@@ -96,6 +96,19 @@ static int lhttp_parser_on_message_complete(http_parser *p) {
 }
 
 
+/* Push the range [at, at + length) of the chunk being executed. When the chunk
+ * is a Buffer, this is a view of it rather than a copy. */
+static void lhttp_parser_pushchunk(lua_State *L, const char *at, size_t length) {
+  /* The chunk is argument 2 of execute(), which is running this callback */
+  size_t chunk_len = 0;
+  const char *chunk = (const char*) colony_tobuffer(L, 2, &chunk_len);
+  if (chunk != NULL && at >= chunk && at + length <= chunk + chunk_len) {
+    colony_createbufferview(L, 2, at - chunk, at - chunk + length);
+  } else {
+    colony_pushbuffer(L, (const uint8_t*) at, length);
+  }
+}
+
 static int lhttp_parser_on_url(http_parser *p, const char *at, size_t length) {
   lua_State *L = p->data;
 
@@ -110,7 +123,7 @@ static int lhttp_parser_on_url(http_parser *p, const char *at, size_t length) {
     return 0;
   };
   /* Push the string argument */
-  colony_pushbuffer(L, (const uint8_t*) at, length);
+  lhttp_parser_pushchunk(L, at, length);
 
   lua_call(L, 1, 1);
 
@@ -132,7 +145,7 @@ static int lhttp_parser_on_header_field(http_parser *p, const char *at, size_t l
     return 0;
   };
   /* Push the string argument */
-  colony_pushbuffer(L, (const uint8_t*) at, length);
+  lhttp_parser_pushchunk(L, at, length);
 
   lua_call(L, 1, 1);
 
@@ -154,7 +167,7 @@ static int lhttp_parser_on_header_value(http_parser *p, const char *at, size_t l
     return 0;
   };
   /* Push the string argument */
-  colony_pushbuffer(L, (const uint8_t*) at, length);
+  lhttp_parser_pushchunk(L, at, length);
 
   lua_call(L, 1, 1);
 
@@ -176,7 +189,7 @@ static int lhttp_parser_on_body(http_parser *p, const char *at, size_t length) {
     return 0;
   };
   /* Push the string argument */
-  colony_pushbuffer(L, (const uint8_t*) at, length);
+  lhttp_parser_pushchunk(L, at, length);
 
   lua_call(L, 1, 1);
 
@@ -16,231 +16,211 @@
 
 #include <colony.h>
 #include "lua_rapidjson.h"
-#include "../tm_json.h"
 
-// Simple methods for referring to the state maintained carried by JSON parsing.
-
-static void state_key_get (lua_State* L) { lua_pushvalue(L, 3); }
-static void state_key_set (lua_State* L) { lua_replace(L, 3); }
-
-static void state_ret_get (lua_State* L) { lua_pushvalue(L, 4); }
-static void state_ret_set (lua_State* L) { lua_replace(L, 4); }
-
-static int state_iskey_get (lua_State* L) { return lua_toboolean(L, 5); }
-static void state_iskey_set (lua_State* L, int val) { lua_pushboolean(L, val); lua_replace(L, 5); }
-
-/* Callback to Lua for parsing default values */
-static void cb_Default (void* state_)
-{
-  // ignore
-  (void) state_;
-}
+/*
+ * parse
+ *
+ * Values are built directly on the Lua stack. Each open container sits on
+ * the stack (an object with its pending key above it), and a finished value
+ * is stored into its parent with a raw set. Containers get their colony
+ * metatable once they are complete.
+ */
 
-/* Callback to Lua for parsing nulls */
-static void cb_Null (void* state)
+// Containers at this depth or shallower are presized from the last container
+// of the same kind seen at the same depth, since siblings tend to share a
+// shape. Hints are capped so one large sibling can't inflate all the rest.
+#define JSON_HINT_DEPTH 32
+#define JSON_HINT_MAX 256
+
+typedef struct {
+  int is_array;
+  int key_pending;
+  size_t count;
+} json_frame_t;
+
+typedef struct {
+  lua_State* L;
+  int arr_ctor;
+  int obj_ctor;
+  int frames_idx;
+  json_frame_t* frames;
+  size_t depth;
+  size_t capacity;
+  size_t hints[2][JSON_HINT_DEPTH];     // [is_array][depth]
+} json_parse_t;
+
+/* Stores the value on top of the stack into the open container */
+static void json_add (json_parse_t* p)
 {
-  lua_State* L = (lua_State*) state;
-  int top = lua_gettop(L);
+  lua_State* L = p->L;
+  if (p->depth == 0) {
+    return;                                 // root value stays on the stack
+  }
 
-  if (colony_isarray(L, -1)) {
-    colony_array_length(L, -1);             // (arr, arr_len)
-    lua_pushnil(L);                         // (arr, arr_len, value)
-    lua_settable(L, -3);                    // (arr)
+  json_frame_t* frame = &p->frames[p->depth - 1];
+  if (frame->is_array) {
+    lua_rawseti(L, -2, frame->count);       // (arr)
   } else {
-    state_key_get(L);                       // (obj, key)
-    lua_pushnil(L);                         // (obj, key, value)
-    lua_settable(L, -3);                    // (obj)
-
-    state_iskey_set(L, 1);
+    lua_rawset(L, -3);                      // (obj)
+    frame->key_pending = 0;
   }
-
-  assert(top == lua_gettop(L));
+  frame->count++;
 }
 
-/* Callback to Lua for parsing booleans */
-static void cb_Bool (void* state, bool value)
+static void json_start (json_parse_t* p, int is_array)
 {
-  lua_State* L = (lua_State*) state;
-  int top = lua_gettop(L);
+  lua_State* L = p->L;
+  luaL_checkstack(L, 4, "JSON nested too deeply");
+
+  if (p->depth == p->capacity) {
+    // Frames live in userdata so that a Lua error cannot leak them.
+    size_t capacity = p->capacity * 2;
+    json_frame_t* frames = (json_frame_t*) lua_newuserdata(L, capacity * sizeof(json_frame_t));
+    memcpy(frames, p->frames, p->depth * sizeof(json_frame_t));
+    lua_replace(L, p->frames_idx);
+    p->frames = frames;
+    p->capacity = capacity;
+  }
 
-  if (colony_isarray(L, -1)) {
-    colony_array_length(L, -1);             // (arr, arr_len)
-    lua_pushboolean(L, value);              // (arr, arr_len, value)
-    lua_settable(L, -3);                    // (arr)
+  size_t hint = p->depth < JSON_HINT_DEPTH ? p->hints[is_array != 0][p->depth] : 0;
+  if (is_array) {
+    lua_createtable(L, hint, 1);
   } else {
-    state_key_get(L);                       // (obj, key)
-    lua_pushboolean(L, value);              // (obj, key, value)
-    lua_settable(L, -3);                    // (obj)
-
-    state_iskey_set(L, 1);
+    lua_createtable(L, 0, hint);
   }
 
-  assert(top == lua_gettop(L));
+  json_frame_t* frame = &p->frames[p->depth++];
+  frame->is_array = is_array;
+  frame->key_pending = 0;
+  frame->count = 0;
 }
 
-/* Callback to Lua for parsing doubles */
-static void cb_Double (void* state, double value)
+static void json_end (json_parse_t* p)
 {
-  lua_State* L = (lua_State*) state;
-  int top = lua_gettop(L);
+  lua_State* L = p->L;
+  json_frame_t* frame = &p->frames[--p->depth];
+  if (p->depth < JSON_HINT_DEPTH) {
+    p->hints[frame->is_array != 0][p->depth] = frame->count < JSON_HINT_MAX ? frame->count : JSON_HINT_MAX;
+  }
 
-  if (colony_isarray(L, -1)) {
-    colony_array_length(L, -1);             // (arr, arr_len)
-    lua_pushnumber(L, value);               // (arr, arr_len, value)
-    lua_settable(L, -3);                    // (arr)
+  // (tbl) -> (ctor, tbl[, length]) -> (value)
+  lua_pushvalue(L, frame->is_array ? p->arr_ctor : p->obj_ctor);
+  lua_insert(L, -2);
+  if (frame->is_array) {
+    lua_pushnumber(L, frame->count);
+    lua_call(L, 2, 1);
   } else {
-    state_key_get(L);                       // (obj, key)
-    lua_pushnumber(L, value);               // (obj, key, value)
-    lua_settable(L, -3);                    // (obj)
-
-    state_iskey_set(L, 1);
+    lua_call(L, 1, 1);
   }
-
-  assert(top == lua_gettop(L));
+  json_add(p);
 }
 
-/* Callback to Lua for parsing ints */
-static void cb_Int (void* state, int value) { cb_Double(state, value); }
-
-/* Callback to Lua for parsing unsigned ints */
-static void cb_Uint (void* state, unsigned value) { cb_Double(state, value); }
-
-/* Callback to Lua for parsing 64 bit ints */
-static void cb_Int64 (void* state, int64_t value) { cb_Double(state, value); }
-
-/* Callback to Lua for parsing unsigned 64 bit ints */
-static void cb_Uint64 (void* state, uint64_t value) { cb_Double(state,value); }
-
-/* Callback to Lua for parsing strings */
-static void cb_String (void* state, const char* value, size_t str_len, bool docopy)
+static void cb_Default (void* state)
 {
-  (void) docopy;
-
-  lua_State* L = (lua_State*) state;
-  int top = lua_gettop(L);
-
-  if (colony_isarray(L, -1)) {
-    colony_array_length(L, -1);             // (arr, arr_len)
-    lua_pushlstring(L, value, str_len);     // (arr, arr_len, str)
-    lua_settable(L, -3);                    // (arr)
-  } else if (state_iskey_get(L)) {
-    lua_pushlstring(L, value, str_len);     // (obj, value)
-    state_key_set(L);                       // (obj)
-
-    state_iskey_set(L, 0);
-  } else {
-    state_key_get(L);                       // (obj, key)
-    lua_pushlstring(L, value, str_len);     // (obj, key, value)
-    lua_settable(L, -3);                    // (obj)
-
-    state_iskey_set(L, 1);
-  }
-
-  assert(top == lua_gettop(L));
+  // ignore
+  (void) state;
 }
 
-/* Callback to Lua for parsing start of an object */
-static void cb_StartObject (void* state)
+/* JSON null is read as undefined */
+static void cb_Null (void* state)
 {
-  lua_State* L = (lua_State*) state;
-  int top = lua_gettop(L);
-
-  if (lua_isnil(L, -1)) {
-    colony_createobj(L, 0, 0);              // (nil, obj2)
-  } else {
-    colony_createobj(L, 0, 0);              // (obj, obj2)
-    if (colony_isarray(L, -2)) {
-      colony_array_length(L, -2);           // (arr, obj2, arr_len)
-    } else {
-      state_key_get(L);                     // (obj)
-    }
-    lua_pushvalue(L, -2);                   // (obj, obj2, value, obj2)
-    lua_settable(L, -4);                    // (obj, obj2)
-  }
-  state_iskey_set(L, 1);
-
-  assert(top + 1 == lua_gettop(L));
+  json_parse_t* p = (json_parse_t*) state;
+  lua_pushnil(p->L);
+  json_add(p);
 }
 
-/* Callback to Lua for parsing end of an object */
-static void cb_EndObject (void* state, size_t value)
+static void cb_Bool (void* state, bool value)
 {
-  (void) value;
-
-  lua_State* L = (lua_State*) state;
-  int top = lua_gettop(L);
-
-  state_ret_set(L);                         // pops stack
-  state_iskey_set(L, 1);
-
-  assert(top - 1 == lua_gettop(L));
+  json_parse_t* p = (json_parse_t*) state;
+  lua_pushboolean(p->L, value);
+  json_add(p);
+}
 
+static void cb_Double (void* state, double value)
+{
+  json_parse_t* p = (json_parse_t*) state;
+  lua_pushnumber(p->L, value);
+  json_add(p);
 }
 
-/* Callback to Lua for parsing start of an array */
-static void cb_StartArray (void* state)
+static void cb_Int (void* state, int value) { cb_Double(state, value); }
+static void cb_Uint (void* state, unsigned value) { cb_Double(state, value); }
+static void cb_Int64 (void* state, int64_t value) { cb_Double(state, value); }
+static void cb_Uint64 (void* state, uint64_t value) { cb_Double(state, value); }
+
+/* Strings are either an object key, left on the stack, or a value */
+static void cb_String (void* state, const char* value, size_t str_len, bool docopy)
 {
-  lua_State* L = (lua_State*) state;
-  int top = lua_gettop(L);
+  (void) docopy;
 
-  if (lua_isnil(L, -1)) {
-    colony_createarray(L, 0);               // (nil, arr)
-  } else {
-    colony_createarray(L, 0);               // (obj, arr)
-    if (colony_isarray(L, -2)) {
-      colony_array_length(L, -2);           // (arr, arr2, arr_len)
-    } else {
-      state_key_get(L);                     // (obj)
+  json_parse_t* p = (json_parse_t*) state;
+  lua_pushlstring(p->L, value, str_len);
+  if (p->depth > 0) {
+    json_frame_t* frame = &p->frames[p->depth - 1];
+    if (!frame->is_array && !frame->key_pending) {
+      frame->key_pending = 1;
+      return;
     }
-    lua_pushvalue(L, -2);                   // (obj, arr, value, arr)
-    lua_settable(L, -4);                    // (obj, arr)
   }
-
-  assert(top + 1 == lua_gettop(L));
+  json_add(p);
 }
 
-/* Callback to Lua for parsing end of an array */
-static void cb_EndArray (void* state, size_t value)
-{
-  (void) value;
-
-  lua_State* L = (lua_State*) state;
-  int top = lua_gettop(L);
-
-  state_ret_set(L);                         // (obj) -> ()
-  state_iskey_set(L, 1);
-
-  assert(top - 1 == lua_gettop(L));
-}
+static void cb_StartObject (void* state) { json_start((json_parse_t*) state, 0); }
+static void cb_EndObject (void* state, size_t count) { (void) count; json_end((json_parse_t*) state); }
+static void cb_StartArray (void* state) { json_start((json_parse_t*) state, 1); }
+static void cb_EndArray (void* state, size_t count) { (void) count; json_end((json_parse_t*) state); }
 
 /* Calls Lua to deal with any error that occurs when parsing */
-static void on_error (lua_State *L, const char* val, parse_error_t err)
+static void on_error (lua_State *L, parse_error_t err)
 {
   lua_pushvalue(L, 2);
-  lua_pushstring(L,val);
+  lua_pushvalue(L, 1);
   lua_pushnumber(L,err.code);
   lua_pushnumber(L,err.offset);
   lua_call(L,3,0);
 }
 
-/* Parsing function called by lua to turn JSON strings to a Lua table */
-static int tm_json_read(lua_State *L)
+/* Parses len bytes of JSON in place and pushes the resulting value. On error
+   nothing is pushed and err is filled in. */
+int lua_rapidjson_read (lua_State *L, const char* value, size_t len, parse_error_t* err)
 {
-  // get the string to parse
-  const char* value = lua_tostring(L, 1);
-  // index 2 is json_error
-
-  // Widen bottom of stack for key and return value state.
-  lua_pushnil(L);
-  lua_insert(L, 3); // key
-  lua_pushnil(L);
-  lua_insert(L, 4); // return value
-  lua_pushnil(L);
-  lua_insert(L, 5); // is key?
+  int base = lua_gettop(L);
+
+  json_parse_t p;
+  memset(&p, 0, sizeof(p));
+  p.L = L;
+
+  lua_getglobal(L, "_colony");
+  lua_getfield(L, -1, "global");
+  lua_getfield(L, -1, "_arr");
+  lua_getfield(L, -2, "_obj");
+  p.arr_ctor = base + 3;
+  p.obj_ctor = base + 4;
+
+  p.capacity = 16;
+  p.frames = (json_frame_t*) lua_newuserdata(L, p.capacity * sizeof(json_frame_t));
+  p.frames_idx = base + 5;
+
+  // The reader only accepts an object or array at the root, so other
+  // values are parsed as the single element of an array.
+  size_t start = 0;
+  while (start < len && (value[start] == ' ' || value[start] == '\t' || value[start] == '\n' || value[start] == '\r')) {
+    start++;
+  }
+  int wrapped = start < len && value[start] != '{' && value[start] != '[';
+  if (wrapped) {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    luaL_addchar(&b, '[');
+    luaL_addlstring(&b, value, len);
+    luaL_addchar(&b, ']');
+    luaL_pushresult(&b);
+    value = lua_tolstring(L, -1, &len);
+  }
 
   // create the reader callback handler
   tm_json_r_handler_t rh;
-  rh.State = L;
+  rh.State = &p;
   rh.Default = cb_Default;
   rh.Null = cb_Null;
   rh.Bool = cb_Bool;
@@ -256,238 +236,302 @@ static int tm_json_read(lua_State *L)
   rh.EndArray = cb_EndArray;
 
   // call rapidjson to parse the string
-  int top = lua_gettop(L);
-  lua_pushnil(L);
-  parse_error_t parse_err = tm_json_parse(rh,value);
-  lua_settop(L, top);
+  *err = tm_json_parse_length(rh, value, len);
+  if (err->code) {
+    lua_settop(L, base);
+    if (wrapped && err->offset > 0) {
+      err->offset--;
+    }
+    return -1;
+  }
+
+  // (_colony, global, _arr, _obj, frames[, wrapped], value) -> (value)
+  if (wrapped) {
+    lua_rawgeti(L, -1, 0);
+  }
+  lua_replace(L, base + 1);
+  lua_settop(L, base + 1);
+  return 0;
+}
+
+/* Parsing function called by lua to turn a JSON string or Buffer into a
+   value. The input is read in place. */
+static int tm_json_read(lua_State *L)
+{
+  // index 2 is json_error
+  size_t len = 0;
+  const char* value = (const char*) colony_toconstdata(L, 1, &len);
+  if (value == NULL) {
+    lua_getglobal(L, "tostring");
+    lua_pushvalue(L, 1);
+    lua_call(L, 1, 1);
+    lua_replace(L, 1);
+    value = lua_tolstring(L, 1, &len);
+  }
+  lua_settop(L, 2);
 
   // if there's an error deal with it
-  if(parse_err.code) { on_error(L,value,parse_err); }
+  parse_error_t parse_err;
+  if (lua_rapidjson_read(L, value, len, &parse_err) != 0) {
+    on_error(L, parse_err);
+    return 0;
+  }
 
-  // return the parsed string
-  state_ret_get(L);
+  // return the parsed value
   return 1;
 }
 
 
 /*
  * stringify
+ *
+ * Values are walked in place on the Lua stack and written straight into the
+ * writer. toJSON and the replacer are called as each value is reached.
  */
 
-/* Creates the writting handler for the writing functions to work */
-static int tm_json_create (lua_State *L)
-{
-  size_t len;
-  const char* indentation = lua_tolstring(L, 1, &len);
+// Bound on nesting, which recurses in C. Cycles are found separately.
+#define JSON_WRITE_DEPTH 1000
 
-  tm_json_w_handler_t wh = tm_json_write_create(indentation, len);
-  void* addr = lua_newuserdata(L, sizeof(tm_json_w_handler_t));
-  memcpy(addr,&wh,sizeof(tm_json_w_handler_t));
-  return 1;
+typedef struct {
+  lua_State* L;
+  tm_json_w_handler_t wh;
+  int replacer;
+  int keys;
+  int seen;                                 // tables being written -> true
+  int depth;
+} json_write_t;
+
+static void json_write_value (json_write_t* w, int holder, int key, int member);
+
+/* Writes an object key. Number keys are converted on a copy, so that a key
+   in use by lua_next is left alone. */
+static void json_write_key (json_write_t* w, int key)
+{
+  lua_State* L = w->L;
+  size_t len = 0;
+  lua_pushvalue(L, key);
+  const char* str = lua_tolstring(L, -1, &len);
+  tm_json_write_string(w->wh, str, len);
+  lua_pop(L, 1);
 }
 
-/* Allows Lua call rapidjson's ability to write out what's in it's buffer */
-static int tm_json_result (lua_State *L)
+static void json_write_array (json_write_t* w, int value)
 {
-  tm_json_w_handler_t* wh = (tm_json_w_handler_t*)lua_touserdata(L, 1);
-  const char* str = tm_json_write_result(*wh);
-  lua_pushstring(L, str);
-  return 1;
+  lua_State* L = w->L;
+  int is_buffer = colony_isbuffer(L, value);
+  size_t len = colony_array_length_i(L, value);
+
+  tm_json_write_array_start(w->wh);
+  for (size_t i = 0; i < len; i++) {
+    lua_pushnumber(L, i);                   // (i)
+    if (is_buffer) {
+      lua_pushnumber(L, i);
+      lua_gettable(L, value);
+    } else {
+      lua_rawgeti(L, value, i);
+    }                                       // (i, value[i])
+    json_write_value(w, value, lua_gettop(L) - 1, 0);
+    lua_pop(L, 1);                          // ()
+  }
+  tm_json_write_array_end(w->wh);
 }
 
-/* Allows Lua call rapidjson's ability to destroy the writing handler */
-static int tm_json_destroy (lua_State *L)
+static void json_write_object (json_write_t* w, int value)
 {
-  tm_json_w_handler_t* wh = (tm_json_w_handler_t*)lua_touserdata(L, 1);
-  tm_json_write_destroy(*wh);
-  return 1;
+  lua_State* L = w->L;
+
+  tm_json_write_object_start(w->wh);
+  if (w->keys) {
+    // A replacer array lists the keys to write, in order.
+    size_t len = colony_array_length_i(L, w->keys);
+    for (size_t i = 0; i < len; i++) {
+      lua_rawgeti(L, w->keys, i);           // (key)
+      if (lua_tostring(L, -1) != NULL) {
+        lua_pushvalue(L, -1);
+        lua_gettable(L, value);             // (key, value[key])
+        if (lua_isnil(L, -1)) {
+          lua_pop(L, 1);
+        } else {
+          json_write_value(w, value, lua_gettop(L) - 1, 1);
+        }
+      }
+      lua_pop(L, 1);                        // ()
+    }
+  } else {
+    lua_pushnil(L);
+    while (lua_next(L, value) != 0) {       // (key, value[key])
+      int type = lua_type(L, -2);
+      if (type == LUA_TSTRING || type == LUA_TNUMBER) {
+        json_write_value(w, value, lua_gettop(L) - 1, 1);
+      } else {
+        lua_pop(L, 1);
+      }                                     // (key)
+    }
+  }
+  tm_json_write_object_end(w->wh);
 }
 
-/* Write a Lua value into rapidjson */
-static int tm_json_writer (lua_State *L)
+/* Writes the value on top of the stack, which is holder[key], and pops it.
+   Object members that can't be serialized are left out, key and all; any
+   other such value is written as null. */
+static void json_write_value (json_write_t* w, int holder, int key, int member)
 {
-  const int IDX_HANDLER = 1;
-  const int IDX_VALUE = 2;
-  const int IDX_REPLACER = 3;
-  const int IDX_OPT_KEY = 4;
-  const int IDX_OPT_THIS = 5;
-
-  tm_json_w_handler_t* wh = (tm_json_w_handler_t*) lua_touserdata(L, IDX_HANDLER);
-  int tojson_called = 0;
-
-  // If a replacer function is given, call it.
-  if (lua_isfunction(L, IDX_REPLACER)) {
-    lua_pushvalue(L, IDX_REPLACER);            // (value[i], fn)
-    lua_pushvalue(L, IDX_OPT_THIS);            // (value[i], fn, value)
-    if (lua_isnil(L, IDX_OPT_KEY)) {
-      lua_pushliteral(L, "");
+  lua_State* L = w->L;
+  int value = lua_gettop(L);
+  luaL_checkstack(L, 8, "JSON nested too deeply");
+
+  // toJSON replaces the value, but is not called again on its result.
+  if (lua_type(L, value) == LUA_TTABLE && !colony_isarray(L, value) && !colony_isbuffer(L, value)) {
+    lua_getfield(L, value, "toJSON");
+    if (lua_isfunction(L, -1)) {
+      lua_pushvalue(L, value);              // this
+      lua_pushvalue(L, key);
+      lua_call(L, 2, 1);
+      lua_replace(L, value);
     } else {
-      lua_pushvalue(L, IDX_OPT_KEY);             // (value[i], fn, value, i)
-    }
-    lua_pushvalue(L, IDX_VALUE);               // (value[i], fn, value, i, value[i])
-    lua_call(L, 3, 1);                         // (value[i])
-    if (lua_isnil(L, -1)) {
       lua_pop(L, 1);
-      return 0;
     }
-    lua_replace(L, 2);
   }
 
-  if (!lua_isnil(L, IDX_OPT_KEY)) {
-    // Write key string.
-    lua_pushvalue(L, IDX_OPT_KEY);
-    size_t key_len = 0;
-    const char* key = lua_tolstring(L, -1, &key_len);
-    lua_pop(L, 1);
-
-    tm_json_write_string(*wh, key, key_len);
+  if (w->replacer) {
+    lua_pushvalue(L, w->replacer);
+    lua_pushvalue(L, holder);               // this
+    lua_pushvalue(L, key);
+    lua_pushvalue(L, value);
+    lua_call(L, 3, 1);
+    lua_replace(L, value);
   }
 
-tojson_loop:
-  switch (lua_type(L, IDX_VALUE)) {
-    case LUA_TNIL: {
-      tm_json_write_null(*wh);
+  switch (lua_type(L, value)) {
+    case LUA_TNIL:
+    case LUA_TFUNCTION:
+    case LUA_TTHREAD:
+    case LUA_TUSERDATA:
+    case LUA_TLIGHTUSERDATA:
+      if (!member) {
+        tm_json_write_null(w->wh);
+      }
       break;
-    }
 
-    case LUA_TBOOLEAN: {
-      tm_json_write_boolean(*wh, lua_toboolean(L, IDX_VALUE));
+    case LUA_TBOOLEAN:
+      if (member) {
+        json_write_key(w, key);
+      }
+      tm_json_write_boolean(w->wh, lua_toboolean(L, value));
       break;
-    }
 
-    case LUA_TNUMBER: {
-      tm_json_write_number(*wh, lua_tonumber(L, IDX_VALUE));
+    case LUA_TNUMBER:
+      if (member) {
+        json_write_key(w, key);
+      }
+      tm_json_write_number(w->wh, lua_tonumber(L, value));
       break;
-    }
 
     case LUA_TSTRING: {
-      size_t str_len = 0;
-      const char* str = lua_tolstring(L, IDX_VALUE, &str_len);
-      tm_json_write_string(*wh, str, str_len);
+      if (member) {
+        json_write_key(w, key);
+      }
+      size_t len = 0;
+      const char* str = lua_tolstring(L, value, &len);
+      tm_json_write_string(w->wh, str, len);
       break;
     }
 
-    case LUA_TTABLE: {
-      // TODO buffer should use .toJSON()
-      if (colony_isarray(L, IDX_VALUE) || colony_isbuffer(L, IDX_VALUE)) {
-        tm_json_write_array_start(*wh);
-
-        size_t value_len = colony_array_length_i(L, IDX_VALUE);
-        for (size_t i = 0; i < value_len; i++) {
-          // Get value in array or buffer.
-          lua_pushnumber(L, i);
-          lua_gettable(L, IDX_VALUE);               // (value[i])
-
-          // If a replacer function is given, call it.
-          if (lua_isfunction(L, 3)) {
-            lua_pushvalue(L, 3);            // (value[i], fn)
-            lua_pushvalue(L, 2);            // (value[i], fn, value)
-            lua_pushnumber(L, i);           // (value[i], fn, value, i)
-            lua_pushvalue(L, -2);           // (value[i], fn, value, i, value[i])
-            lua_call(L, 3, 1);              // (value[i])
-            lua_remove(L, -2);
-          }
-
-          // Only recursively solve for serializable values.
-          switch (lua_type(L, -1)) {
-            // Convert exotic variable types to null.
-            case LUA_TFUNCTION:
-            case LUA_TTHREAD:
-            case LUA_TUSERDATA:
-              tm_json_write_null(*wh);
-              break;
-
-            default:
-              lua_pushcfunction(L, tm_json_writer);
-              lua_pushvalue(L, 1);          // (value[i], recurser, handler)
-              lua_pushvalue(L, -3);         // (value[i], recurser, handler, value[i])
-              lua_pushvalue(L, IDX_REPLACER);
-              lua_pushnil(L);
-              lua_pushvalue(L, IDX_VALUE);  // this
-              lua_call(L, 5, 0);            // (value[i])
-              break;
-          }
-          
-          lua_pop(L, 1);                    // ()
-        }
-        tm_json_write_array_end(*wh);
+    case LUA_TTABLE:
+      if (member) {
+        json_write_key(w, key);
+      }
+      lua_pushvalue(L, value);
+      lua_rawget(L, w->seen);
+      if (lua_toboolean(L, -1)) {
+        luaL_error(L, "Converting circular structure to JSON");
+      }
+      lua_pop(L, 1);
+      if (++w->depth > JSON_WRITE_DEPTH) {
+        luaL_error(L, "JSON nested too deeply");
+      }
+      lua_pushvalue(L, value);
+      lua_pushboolean(L, 1);
+      lua_rawset(L, w->seen);
+      if (colony_isarray(L, value) || colony_isbuffer(L, value)) {
+        json_write_array(w, value);
       } else {
-        // Attempt to call .toJSON to override value.
-        // If a toJSON method exists, call method, replace IDX_VALUE and loop.
-        if (!tojson_called && lua_type(L, -1) == LUA_TTABLE) {
-          lua_getfield(L, IDX_VALUE, "toJSON");
-          if (lua_isfunction(L, -1) != 0) {
-            lua_pushvalue(L, IDX_VALUE);            // val for `this`
-            lua_pushvalue(L, IDX_OPT_KEY);
-            lua_call(L, 2, 1);
-            lua_replace(L, IDX_VALUE);
-            tojson_called = 1;
-            goto tojson_loop;
-          } else {
-            lua_pop(L, 1);
-          }
-        }
-
-        tm_json_write_object_start(*wh);
-
-        // Replacer array with keys.
-        if (lua_type(L, IDX_REPLACER) == LUA_TTABLE) {
-          lua_createtable(L, 0, 0);
-
-          size_t replacer_len = colony_array_length_i(L, IDX_REPLACER);
-          for (size_t i = 0; i < replacer_len; i++) {
-            lua_pushnumber(L, i);           // (table, i)
-            lua_gettable(L, IDX_REPLACER);  // (table, key)
-            lua_tostring(L, -1); // cast to string
-            lua_pushvalue(L, -1);           // (table, key, key)
-            lua_gettable(L, IDX_VALUE);     // (table, key, value)
-            if (!lua_isnil(L, -1)) {
-              lua_settable(L, -3);          // (table)
-            } else {
-              lua_pop(L, 2);                // (table)
-            }
-          }
-          lua_replace(L, IDX_VALUE);
-        }
-
-        /* table is in the stack at index 't' */
-        lua_pushnil(L);  /* first key */
-        while (lua_next(L, IDX_VALUE) != 0) {       // (value[i])
-          switch (lua_type(L, -1)) {
-            // Convert exotic variable types to null.
-            case LUA_TFUNCTION:
-            case LUA_TTHREAD:
-            case LUA_TUSERDATA:
-              break;
-
-            default:
-              lua_pushcfunction(L, tm_json_writer);
-              lua_pushvalue(L, 1);          // (value[i], recurser, handler)
-              lua_pushvalue(L, -3);         // (value[i], recurser, handler, value[i])
-              lua_pushvalue(L, IDX_REPLACER);
-              lua_pushvalue(L, -6);
-              lua_pushvalue(L, IDX_VALUE);  // this
-              lua_call(L, 5, 0);            // (value[i])
-              break;
-          }
-          
-          lua_pop(L, 1);                    // ()
-        }
-        tm_json_write_object_end(*wh);
+        json_write_object(w, value);
       }
-      break;
-    }
-
-    // Expose exotic variables as "{}""
-    default:
-      tm_json_write_object_start(*wh);
-      tm_json_write_object_end(*wh);
+      lua_pushvalue(L, value);
+      lua_pushnil(L);
+      lua_rawset(L, w->seen);
+      w->depth--;
       break;
   }
 
+  lua_settop(L, value - 1);
+}
+
+/* Writes value to the writer: (wh, value, replacer) */
+static int json_write_protected (lua_State *L)
+{
+  json_write_t w;
+  w.L = L;
+  w.wh = *(tm_json_w_handler_t*) lua_touserdata(L, 1);
+  w.replacer = lua_isfunction(L, 3) ? 3 : 0;
+  w.keys = lua_istable(L, 3) ? 3 : 0;
+  w.depth = 0;
+  lua_newtable(L);
+  w.seen = lua_gettop(L);
+
+  // The replacer is first called with the value as "" of a holder object.
+  if (w.replacer) {
+    lua_createtable(L, 0, 1);
+    lua_pushvalue(L, 2);
+    lua_setfield(L, -2, "");
+  } else {
+    lua_pushnil(L);
+  }
+  lua_pushliteral(L, "");
+  lua_pushvalue(L, 2);                      // (wh, value, replacer, seen, holder, "", value)
+  json_write_value(&w, 5, 6, 0);
   return 0;
 }
 
+/* JSON.stringify(value, replacer, spacer) for Lua. The shared writer is used
+   unless a replacer or toJSON is itself stringifying. */
+static int tm_json_stringify (lua_State *L)
+{
+  lua_settop(L, 3);
+  size_t spacer_len = 0;
+  const char* spacer = lua_tolstring(L, 3, &spacer_len);
+  if (spacer == NULL) {
+    spacer = "";
+  }
+
+  tm_json_w_handler_t wh;
+  int shared = tm_json_write_shared(&wh, spacer, spacer_len) == 0;
+  if (!shared) {
+    wh = tm_json_write_create(spacer, spacer_len);
+  }
+
+  // The writer is released even if a toJSON or replacer throws.
+  lua_pushvalue(L, lua_upvalueindex(1));
+  lua_pushlightuserdata(L, &wh);
+  lua_pushvalue(L, 1);
+  lua_pushvalue(L, 2);
+  int status = lua_pcall(L, 3, 0, 0);
+  if (status == 0) {
+    lua_pushlstring(L, tm_json_write_result(wh), tm_json_write_length(wh));
+  }
+
+  if (shared) {
+    tm_json_write_release(wh);
+  } else {
+    tm_json_write_destroy(wh);
+  }
+  if (status != 0) {
+    return lua_error(L);
+  }
+  return 1;
+}
+
 /* Creates and pushes to a table the function that Lua needs to access */
 int lua_open_rapidjson (lua_State *L)
 {
@@ -496,17 +540,9 @@ int lua_open_rapidjson (lua_State *L)
   lua_pushcfunction(L, tm_json_read);
   lua_setfield(L, -2, "parse");
 
-  lua_pushcfunction(L, tm_json_create);
-  lua_setfield(L, -2, "create_writer");
-
-  lua_pushcfunction(L, tm_json_result);
-  lua_setfield(L, -2, "result");
-
-  lua_pushcfunction(L, tm_json_destroy);
-  lua_setfield(L, -2, "destroy");
-
-  lua_pushcfunction(L, tm_json_writer);
-  lua_setfield(L, -2, "write_value");
+  lua_pushcfunction(L, json_write_protected);
+  lua_pushcclosure(L, tm_json_stringify, 1);
+  lua_setfield(L, -2, "stringify");
 
   return 1;
 
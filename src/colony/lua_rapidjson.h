@@ -14,6 +14,9 @@
 #include <lauxlib.h>
 #include <lualib.h>
 
+#include "../tm_json.h"
+
 int lua_open_rapidjson(lua_State *L);
+int lua_rapidjson_read(lua_State *L, const char* value, size_t len, parse_error_t* err);
 
 #endif
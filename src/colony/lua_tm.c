@@ -12,10 +12,12 @@
 #include <lualib.h>
 #include <math.h>
 #include <assert.h>
+#include <string.h>
 
 #include "tm.h"
 #include "colony.h"
 #include "order32.h"
+#include "lua_rapidjson.h"
 
 #if COLONY_JIT
 #include <lj_obj.h>
@@ -254,17 +256,89 @@ static int l_tm_tcp_write (lua_State* L)
 }
 
 
+// Default upper bound on how much a single tcp_read drains.
+#define TCP_READ_DEFAULT_SIZE (64*1024)
+
+// Reads from the socket until it is empty or `buf_len` bytes have arrived.
+static int tcp_drain (tm_socket_t socket, uint8_t* buf, size_t buf_len, size_t* total)
+{
+  *total = 0;
+  while (*total < buf_len) {
+    size_t wanted = buf_len - *total;
+    size_t chunk_len = wanted;
+    int err = tm_tcp_read(socket, &buf[*total], &chunk_len);
+    if (err != 0) {
+      // Data that was already read takes precedence over EAGAIN and friends.
+      return *total > 0 ? 0 : err;
+    }
+    *total += chunk_len;
+    // A short read means the socket is empty (or closed), so don't ask again.
+    if (chunk_len < wanted) {
+      break;
+    }
+  }
+  return 0;
+}
+
+// A single tcp_read drains at most this much. Reads go through a scratch area
+// that is kept between calls and grows to no more than this, so each read
+// allocates only the Buffer it returns.
+#define TCP_READ_MAX_SIZE (64*1024)
+
 static int l_tm_tcp_read (lua_State* L)
 {
+  static uint8_t* scratch = NULL;
+  static size_t scratch_len = 0;
+
   tm_socket_t socket = (tm_socket_t) lua_tonumber(L, 1);
+  size_t limit = lua_isnumber(L, 2) ? (size_t) lua_tonumber(L, 2) : TCP_READ_DEFAULT_SIZE;
+  if (limit == 0) {
+    limit = TCP_READ_DEFAULT_SIZE;
+  }
+  if (limit > TCP_READ_MAX_SIZE) {
+    limit = TCP_READ_MAX_SIZE;
+  }
 
-  uint8_t buf[512];
-  size_t buf_len = sizeof(buf);
-  int err = tm_tcp_read(socket, buf, &buf_len);
-  (void) err;
-  
-  colony_pushbuffer(L, buf, buf_len);
-  return 1;
+  if (scratch_len < limit) {
+    uint8_t* grown = realloc(scratch, limit);
+    if (grown == NULL) {
+      colony_createbuffer(L, 0);
+      lua_pushnumber(L, ENOMEM);
+      return 2;
+    }
+    scratch = grown;
+    scratch_len = limit;
+  }
+
+  size_t total = 0;
+  int err = tcp_drain(socket, scratch, limit, &total);
+
+  colony_pushbuffer(L, scratch, total);
+  lua_pushnumber(L, err);
+  return 2;
+}
+
+
+static int l_tm_tcp_read_into (lua_State* L)
+{
+  tm_socket_t socket = (tm_socket_t) lua_tonumber(L, 1);
+  size_t buf_len = 0;
+  uint8_t* buf = colony_tobuffer(L, 2, &buf_len);
+  size_t offset = (size_t) lua_tonumber(L, 3);
+  if (buf == NULL || offset > buf_len) {
+    return luaL_error(L, "tcp_read_into requires a buffer and an offset within it");
+  }
+  size_t length = lua_isnumber(L, 4) ? (size_t) lua_tonumber(L, 4) : buf_len - offset;
+  if (length > buf_len - offset) {
+    length = buf_len - offset;
+  }
+
+  size_t total = 0;
+  int err = tcp_drain(socket, &buf[offset], length, &total);
+
+  lua_pushnumber(L, total);
+  lua_pushnumber(L, err);
+  return 2;
 }
 
 
@@ -405,6 +479,17 @@ static int l_tm_ssl_session_free (lua_State* L)
   return 1;
 }
 
+// ssl_session_stats() -> hits, misses
+static int l_tm_ssl_session_stats (lua_State* L)
+{
+  uint32_t hits, misses;
+  tm_ssl_session_stats(&hits, &misses);
+
+  lua_pushnumber(L, hits);
+  lua_pushnumber(L, misses);
+  return 2;
+}
+
 static int l_tm_ssl_writeable (lua_State* L)
 {
   tm_ssl_session_t session = (tm_ssl_session_t) lua_touserdata(L, 1);
@@ -437,10 +522,10 @@ static int l_tm_ssl_read (lua_State* L)
   uint8_t buf[20000];
   size_t buf_len = sizeof(buf);
   int err = tm_ssl_read(session, buf, &buf_len);
-  (void) err;
   
   colony_pushbuffer(L, buf, buf_len);
-  return 1;
+  lua_pushnumber(L, err);
+  return 2;
 }
 
 #endif
@@ -504,6 +589,52 @@ static int l_tm_clear_raw_timeout (lua_State* L) {
 }
 
 
+/**
+ * Immediates
+ */
+
+static int l_tm_set_immediate (lua_State* L) {
+  lua_settop(L, 1);
+  int callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  unsigned id = tm_setimmediate(callback_ref);
+  lua_pushnumber(L, id);
+  return 1;
+}
+
+static int l_tm_clear_immediate (lua_State* L) {
+  unsigned id = (unsigned) lua_tonumber(L, 1);
+  tm_clearimmediate(id);
+  return 0;
+}
+
+static int l_tm_next_tick (lua_State* L) {
+  lua_settop(L, 1);
+  int callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  tm_nexttick(callback_ref);
+  return 0;
+}
+
+
+/**
+ * Watchers
+ */
+
+static int l_tm_fd_watch (lua_State* L) {
+  tm_socket_t fd = (tm_socket_t) lua_tonumber(L, 1);
+  unsigned flags = (unsigned) lua_tonumber(L, 2);
+  lua_settop(L, 3);
+  int callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_pushnumber(L, tm_watch_start(fd, flags, callback_ref));
+  return 1;
+}
+
+static int l_tm_fd_unwatch (lua_State* L) {
+  tm_socket_t fd = (tm_socket_t) lua_tonumber(L, 1);
+  tm_watch_stop(fd);
+  return 0;
+}
+
+
 /**
  * Buffer
  */
@@ -511,37 +642,58 @@ static int l_tm_clear_raw_timeout (lua_State* L) {
 static int l_tm_buffer_create (lua_State *L)
 {
   size_t n = (size_t) lua_tonumber(L, 1);
-  lua_newuserdata(L, n);
+  colony_createbuffer(L, n);
   return 1;
 }
 
-static int l_tm_buffer_index (lua_State *L)
+static int l_tm_buffer_slice (lua_State *L)
 {
-  uint8_t *ud = (uint8_t *) lua_touserdata(L, 1);
-  size_t index = (size_t) lua_tonumber(L, 2);
-  lua_pushlightuserdata(L, &ud[index]);
+  size_t start = (size_t) lua_tonumber(L, 2);
+  size_t end = (size_t) lua_tonumber(L, 3);
+  colony_createbufferview(L, 1, start, end);
   return 1;
 }
 
+static int l_tm_buffer_metatable (lua_State *L)
+{
+  colony_buffer_metatable(L);
+  return 1;
+}
 
-static int l_tm_buffer_set (lua_State *L)
+static int l_tm_buffer_length (lua_State *L)
 {
-  uint8_t *ud = (uint8_t *) lua_touserdata(L, 1);
-  size_t index = (size_t) lua_tonumber(L, 2);
-  double newvalue = (double) lua_tonumber(L, 3);
-  
-  if (newvalue < 0) {
-    ud[index] = 0x100 - (((uint32_t) -newvalue) % 0x100);
+  size_t len = 0;
+  if (colony_tobuffer(L, 1, &len) == NULL) {
+    lua_pushnil(L);
+  } else {
+    lua_pushnumber(L, len);
+  }
+  return 1;
+}
+
+
+// Wraps a number into a byte the way typed array assignment does.
+static uint8_t buffer_tobyte (double value)
+{
+  if (value < 0) {
+    return 0x100 - (((uint32_t) -value) % 0x100);
   } else {
-    ud[index] = (((uint32_t) newvalue) % 0x100);
+    return (((uint32_t) value) % 0x100);
   }
+}
+
+static int l_tm_buffer_set (lua_State *L)
+{
+  uint8_t *ud = colony_tobuffer(L, 1, NULL);
+  size_t index = (size_t) lua_tonumber(L, 2);
+  ud[index] = buffer_tobyte((double) lua_tonumber(L, 3));
   return 0;
 }
 
 
 static int l_tm_buffer_get (lua_State *L)
 {
-  uint8_t *ud = (uint8_t *) lua_touserdata(L, 1);
+  uint8_t *ud = colony_tobuffer(L, 1, NULL);
   size_t index = (size_t) lua_tonumber(L, 2);
   lua_pushnumber(L, ud[index]);
   return 1;
@@ -549,7 +701,7 @@ static int l_tm_buffer_get (lua_State *L)
 
 #define READ_BUFFER(N, T) static int N (lua_State *L) \
   { \
-    uint8_t *ud = (uint8_t *) lua_touserdata(L, 1); \
+    uint8_t *ud = colony_tobuffer(L, 1, NULL); \
     size_t index = (size_t) lua_tonumber(L, 2); \
     uint8_t *a = &ud[index]; \
     lua_pushnumber(L, T); \
@@ -561,7 +713,7 @@ static int l_tm_buffer_get (lua_State *L)
 
 #define WRITE_BUFFER(N, T, C) static int N (lua_State *L) \
 { \
-  uint8_t *ud = (uint8_t *) lua_touserdata(L, 1); \
+  uint8_t *ud = colony_tobuffer(L, 1, NULL); \
   size_t index = (size_t) lua_tonumber(L, 2); \
   T value = lua_type(L, 3) == LUA_TNUMBER \
     ? (T) lua_tonumber(L, 3) \
@@ -600,7 +752,7 @@ WRITE_BUFFER(l_tm_buffer_write_int32be, int32_t, WRITE_32(value, a[0], a[1], a[2
 
 static int l_tm_buffer_read_float (lua_State *L)
 {
-  uint8_t *ud = (uint8_t *) lua_touserdata(L, 1);
+  uint8_t *ud = colony_tobuffer(L, 1, NULL);
   size_t index = (size_t) lua_tonumber(L, 2);
   uint8_t le = (int) lua_tonumber(L, 3);
 
@@ -618,7 +770,7 @@ static int l_tm_buffer_read_float (lua_State *L)
 
 static int l_tm_buffer_read_double (lua_State *L)
 {
-  uint8_t *ud = (uint8_t *) lua_touserdata(L, 1);
+  uint8_t *ud = colony_tobuffer(L, 1, NULL);
   size_t index = (size_t) lua_tonumber(L, 2);
   uint8_t le = (int) lua_tonumber(L, 3);
 
@@ -636,7 +788,7 @@ static int l_tm_buffer_read_double (lua_State *L)
 
 static int l_tm_buffer_write_float (lua_State *L)
 {
-  uint8_t *ud = (uint8_t *) lua_touserdata(L, 1);
+  uint8_t *ud = colony_tobuffer(L, 1, NULL);
   size_t index = (size_t) lua_tonumber(L, 2);
   float value = (float) lua_tonumber(L, 3);
   uint8_t le = (int) lua_tonumber(L, 4);
@@ -653,7 +805,7 @@ static int l_tm_buffer_write_float (lua_State *L)
 
 static int l_tm_buffer_write_double (lua_State *L)
 {
-  uint8_t *ud = (uint8_t *) lua_touserdata(L, 1);
+  uint8_t *ud = colony_tobuffer(L, 1, NULL);
   size_t index = (size_t) lua_tonumber(L, 2);
   double value = (double) lua_tonumber(L, 3);
   uint8_t le = (int) lua_tonumber(L, 4);
@@ -671,7 +823,7 @@ static int l_tm_buffer_write_double (lua_State *L)
 
 static int l_tm_buffer_fill (lua_State *L)
 {
-  uint8_t *a = (uint8_t *) lua_touserdata(L, 1);
+  uint8_t *a = colony_tobuffer(L, 1, NULL);
   int start = (int) lua_tonumber(L, 3);
   int end = (int) lua_tonumber(L, 4);
 
@@ -696,8 +848,8 @@ static int l_tm_buffer_fill (lua_State *L)
 
 static int l_tm_buffer_copy (lua_State *L)
 {
-  uint8_t *source = (uint8_t *) lua_touserdata(L, 1);
-  uint8_t *target = (uint8_t *) lua_touserdata(L, 2);
+  uint8_t *source = colony_tobuffer(L, 1, NULL);
+  uint8_t *target = colony_tobuffer(L, 2, NULL);
   int targetStart = (int) lua_tonumber(L, 3);
   int sourceStart = (int) lua_tonumber(L, 4);
   int sourceEnd = (int) lua_tonumber(L, 5);
@@ -708,7 +860,7 @@ static int l_tm_buffer_copy (lua_State *L)
 
 static int l_tm_buffer_tobytestring (lua_State *L)
 {
-  const char *source = lua_touserdata(L, 1);
+  const char *source = (const char *) colony_tobuffer(L, 1, NULL);
   size_t offset = (int) lua_tonumber(L, 2);
   size_t endOffset = (int) lua_tonumber(L, 3);
   source += offset;
@@ -717,6 +869,157 @@ static int l_tm_buffer_tobytestring (lua_State *L)
 }
 
 
+// buffer_from_string(str) -> Buffer holding the raw bytes of a Lua string
+static int l_tm_buffer_from_string (lua_State *L)
+{
+  size_t len = 0;
+  const uint8_t* str = (const uint8_t*) luaL_checklstring(L, 1, &len);
+  colony_pushbuffer(L, str, len);
+  return 1;
+}
+
+// buffer_from_array(arr, length) -> Buffer. Elements are converted like
+// buf[i] = arr[i]; a Buffer source is copied directly.
+static int l_tm_buffer_from_array (lua_State *L)
+{
+  size_t src_len = 0;
+  const uint8_t* src = colony_tobuffer(L, 1, &src_len);
+  if (src != NULL) {
+    colony_pushbuffer(L, src, src_len);
+    return 1;
+  }
+
+  size_t len = (size_t) lua_tonumber(L, 2);
+  uint8_t* buf = colony_createbuffer(L, len);
+  for (size_t i = 0; i < len; i++) {
+    lua_rawgeti(L, 1, i);
+    buf[i] = buffer_tobyte(lua_tonumber(L, -1));
+    lua_pop(L, 1);
+  }
+  return 1;
+}
+
+static int hex_value (uint8_t c)
+{
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// buffer_from_hex(str) -> Buffer. Decoding stops at the first character
+// that is not a hex digit.
+static int l_tm_buffer_from_hex (lua_State *L)
+{
+  size_t len = 0;
+  const uint8_t* hex = (const uint8_t*) luaL_checklstring(L, 1, &len);
+
+  size_t valid = 0;
+  while (valid < len && hex_value(hex[valid]) >= 0) {
+    valid++;
+  }
+
+  uint8_t* buf = colony_createbuffer(L, valid / 2);
+  for (size_t i = 0; i < valid / 2; i++) {
+    buf[i] = (hex_value(hex[2*i]) << 4) | hex_value(hex[2*i + 1]);
+  }
+  return 1;
+}
+
+// buffer_tohex(buf, start, end, [separator]) -> lowercase hex string
+static int l_tm_buffer_tohex (lua_State *L)
+{
+  static const char digits[] = "0123456789abcdef";
+  size_t buf_len = 0;
+  const uint8_t* buf = colony_tobuffer(L, 1, &buf_len);
+  size_t start = (size_t) lua_tonumber(L, 2);
+  size_t end = lua_isnoneornil(L, 3) ? buf_len : (size_t) lua_tonumber(L, 3);
+  size_t sep_len = 0;
+  const char* sep = lua_isnoneornil(L, 4) ? NULL : lua_tolstring(L, 4, &sep_len);
+
+  if (buf == NULL || end > buf_len) {
+    end = buf == NULL ? 0 : buf_len;
+  }
+
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  for (size_t i = start; i < end; i++) {
+    if (sep_len > 0 && i > start) {
+      luaL_addlstring(&b, sep, sep_len);
+    }
+    luaL_addchar(&b, digits[buf[i] >> 4]);
+    luaL_addchar(&b, digits[buf[i] & 0xf]);
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+// buffer_toarray(buf) -> table of bytes keyed from 0, for js_arr
+static int l_tm_buffer_toarray (lua_State *L)
+{
+  size_t buf_len = 0;
+  const uint8_t* buf = colony_tobuffer(L, 1, &buf_len);
+  if (buf == NULL) {
+    buf_len = 0;
+  }
+
+  lua_createtable(L, buf_len > 0 ? buf_len - 1 : 0, 1);
+  for (size_t i = 0; i < buf_len; i++) {
+    lua_pushnumber(L, buf[i]);
+    lua_rawseti(L, -2, i);
+  }
+  return 1;
+}
+
+
+/**
+ * base64
+ */
+
+// base64_encode(buf, [start, end]) -> padded base64 string
+static int l_tm_base64_encode (lua_State *L)
+{
+  size_t buf_len = 0;
+  const uint8_t* buf = colony_toconstdata(L, 1, &buf_len);
+  size_t start = lua_isnoneornil(L, 2) ? 0 : (size_t) lua_tonumber(L, 2);
+  size_t end = lua_isnoneornil(L, 3) ? buf_len : (size_t) lua_tonumber(L, 3);
+
+  if (buf == NULL || end > buf_len) {
+    end = buf == NULL ? 0 : buf_len;
+  }
+  if (start > end) {
+    start = end;
+  }
+
+  // Encode whole blocks straight into the Lua buffer.
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  size_t chunk = (LUAL_BUFFERSIZE / 4) * 3;
+  for (size_t i = start; i < end; i += chunk) {
+    size_t n = end - i < chunk ? end - i : chunk;
+    char* out = luaL_prepbuffer(&b);
+    luaL_addsize(&b, tm_base64_encode(&buf[i], n, out));
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+// base64_decode(str) -> Buffer
+static int l_tm_base64_decode (lua_State *L)
+{
+  size_t len = 0;
+  const char* str = luaL_checklstring(L, 1, &len);
+
+  uint8_t* buf = colony_createbuffer(L, tm_base64_decode_length(str, len));
+  tm_base64_decode(str, len, buf);
+  return 1;
+}
+
+
 /**
  * fs
  */
@@ -1032,13 +1335,128 @@ static int l_tm_str_from_utf8 (lua_State* L)
 }
 
 
+// Strings shorter than this are cheap enough to decode from the start.
+#define STR_INDEX_MIN_LEN 32
+// Bounds on the cache, by entries and by the bytes of the strings and indexes
+// it holds. Least recently used entries are evicted one at a time to stay
+// within them, except that the STR_INDEX_KEEP most recently used are always
+// kept, so code alternating between a few large strings doesn't rebuild their
+// indexes on every access.
+#define STR_INDEX_MAX_ENTRIES 256
+#define STR_INDEX_MAX_BYTES (256*1024)
+#define STR_INDEX_KEEP 4
+#define STR_INDEX_CACHE "colony_str_index"
+
+// A cached index, stamped with its last use. The index follows the header.
+typedef struct {
+  uint64_t used;
+  size_t bytes;
+} str_index_entry_t;
+
+static uint64_t str_index_clock = 0;
+
+// Evicts entries from the cache table on top of the stack until one of
+// `bytes` more fits. Entry count lives at [1] and byte count at [2]; all
+// other keys are strings.
+static void str_index_evict (lua_State* L, size_t bytes)
+{
+  int cache = lua_gettop(L);
+  lua_rawgeti(L, cache, 1);
+  size_t count = (size_t) lua_tonumber(L, -1);
+  lua_rawgeti(L, cache, 2);
+  size_t total = (size_t) lua_tonumber(L, -1);
+  lua_pop(L, 2);
+
+  while (count > 0 && (count >= STR_INDEX_MAX_ENTRIES || total + bytes > STR_INDEX_MAX_BYTES)) {
+    lua_pushnil(L);                         // (victim)
+    str_index_entry_t* victim = NULL;
+    lua_pushnil(L);
+    while (lua_next(L, cache) != 0) {       // (victim, key, entry)
+      str_index_entry_t* e = (str_index_entry_t*) lua_touserdata(L, -1);
+      if (lua_type(L, -2) == LUA_TSTRING && e != NULL && (victim == NULL || e->used < victim->used)) {
+        victim = e;
+        lua_pushvalue(L, -2);
+        lua_replace(L, cache + 1);
+      }
+      lua_pop(L, 1);
+    }
+    if (victim == NULL || victim->used + STR_INDEX_KEEP > str_index_clock) {
+      lua_pop(L, 1);
+      break;
+    }
+    count--;
+    total -= victim->bytes;
+    lua_pushnil(L);
+    lua_rawset(L, cache);                   // ()
+  }
+
+  lua_pushnumber(L, count + 1);
+  lua_rawseti(L, cache, 1);
+  lua_pushnumber(L, total + bytes);
+  lua_rawseti(L, cache, 2);
+}
+
+// Returns the UCS-2 index of the string at stack position n, building it on
+// first use. The cache table keeps its strings alive, which keeps the string
+// data (and so the index) valid for as long as the entry exists.
+static const tm_str_index_t* str_index (lua_State* L, int n, const uint8_t* buf, size_t buf_len)
+{
+  if (buf_len < STR_INDEX_MIN_LEN) {
+    return NULL;
+  }
+
+  str_index_clock++;
+  lua_getfield(L, LUA_REGISTRYINDEX, STR_INDEX_CACHE);
+  if (lua_istable(L, -1)) {
+    lua_pushvalue(L, n);
+    lua_rawget(L, -2);
+    str_index_entry_t* entry = (str_index_entry_t*) lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (entry != NULL) {
+      lua_pop(L, 1);
+      entry->used = str_index_clock;
+      return (const tm_str_index_t*) (entry + 1);
+    }
+  } else {
+    lua_pop(L, 1);
+    lua_createtable(L, 2, 0);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, STR_INDEX_CACHE);
+  }
+
+  size_t index_size = tm_str_index_size(buf, buf_len);
+  str_index_evict(L, buf_len + index_size);
+
+  str_index_entry_t* entry = (str_index_entry_t*) lua_newuserdata(L, sizeof(str_index_entry_t) + index_size);
+  entry->used = str_index_clock;
+  entry->bytes = buf_len + index_size;
+  tm_str_index_t* index = (tm_str_index_t*) (entry + 1);
+  tm_str_index_build(buf, buf_len, index);
+  lua_pushvalue(L, n);
+  lua_pushvalue(L, -2);
+  lua_rawset(L, -4);
+  lua_pop(L, 2);
+  return index;
+}
+
 static int l_tm_str_codeat (lua_State* L)
 {
   size_t buf_len = 0;
   const uint8_t* buf = (const uint8_t*) lua_tolstring(L, 1, &buf_len);
-  uint32_t idx = (uint32_t) lua_tonumber(L, 2);
+  lua_Number rawIdx = lua_tonumber(L, 2);
+  if (rawIdx != rawIdx) {
+    rawIdx = 0;                             // a NaN index is read as 0
+  }
 
-  lua_pushnumber(L, tm_str_codeat(buf, buf_len, idx));
+  uint32_t c = TM_UTF8_DECODE_ERROR;
+  if (rawIdx >= 0 && rawIdx < buf_len) {
+    c = tm_str_index_codeat(buf, buf_len, str_index(L, 1, buf, buf_len), (size_t) rawIdx);
+  }
+  if (c == TM_UTF8_DECODE_ERROR) {
+    lua_pushnumber(L, NAN);
+  } else {
+    lua_pushnumber(L, c);
+  }
   return 1;
 }
 
@@ -1061,7 +1479,7 @@ static int l_tm_str_lookup_JsToLua (lua_State* L)
   lua_Number rawIdx = lua_tonumber(L, 2);
   size_t idx = (rawIdx < SIZE_MAX) ? (size_t)rawIdx : SIZE_MAX;
   size_t seq_len;
-  lua_pushnumber(L, tm_str_lookup_JsToLua(buf, buf_len, idx, &seq_len) + 1);
+  lua_pushnumber(L, tm_str_index_JsToLua(buf, buf_len, str_index(L, 1, buf, buf_len), idx, &seq_len) + 1);
   lua_pushnumber(L, seq_len);
   return 2;
 }
@@ -1075,20 +1493,437 @@ static int l_tm_str_lookup_LuaToJs (lua_State* L)
     // str methods are expected to pre-sanitize. make issue obvious if not!
     return luaL_error(L, "assertion failure: invalid string lookup value");
   }
-  lua_pushnumber(L, tm_str_lookup_LuaToJs(buf, idx));
+  lua_pushnumber(L, tm_str_index_LuaToJs(buf, buf_len, str_index(L, 1, buf, buf_len), idx));
   return 1;
 }
 
 
-#ifdef ENABLE_NET
+/**
+ * String builder
+ */
+
+#define STRBUF_MT "tm_strbuf"
 
-uint32_t tm__sync_gethostbyname (const char *domain);
+typedef struct {
+  char* data;
+  size_t length;
+  size_t capacity;
+} tm_strbuf_t;
 
-static int l_tm__sync_gethostbyname (lua_State* L)
+static void strbuf_reserve (lua_State* L, tm_strbuf_t* sb, size_t extra)
+{
+  if (sb->length + extra <= sb->capacity) {
+    return;
+  }
+  size_t capacity = sb->capacity > 0 ? sb->capacity : 64;
+  while (capacity < sb->length + extra) {
+    capacity *= 2;
+  }
+  char* data = realloc(sb->data, capacity);
+  if (data == NULL) {
+    luaL_error(L, "string builder out of memory");
+  }
+  sb->data = data;
+  sb->capacity = capacity;
+}
+
+// Pushes the string form of the value at index, going through tostring
+// (and so __tostring) for anything that isn't a string or number.
+static const char* str_tolstring (lua_State* L, int index, size_t* len)
+{
+  if (index < 0) {
+    index = lua_gettop(L) + index + 1;
+  }
+  if (lua_type(L, index) == LUA_TSTRING || lua_type(L, index) == LUA_TNUMBER) {
+    lua_pushvalue(L, index);
+  } else {
+    lua_getglobal(L, "tostring");
+    lua_pushvalue(L, index);
+    lua_call(L, 1, 1);
+  }
+  return lua_tolstring(L, -1, len);
+}
+
+static int l_tm_strbuf_gc (lua_State* L)
+{
+  tm_strbuf_t* sb = (tm_strbuf_t*) luaL_checkudata(L, 1, STRBUF_MT);
+  free(sb->data);
+  sb->data = NULL;
+  sb->length = sb->capacity = 0;
+  return 0;
+}
+
+// strbuf_create() -> builder
+static int l_tm_strbuf_create (lua_State* L)
+{
+  tm_strbuf_t* sb = (tm_strbuf_t*) lua_newuserdata(L, sizeof(tm_strbuf_t));
+  sb->data = NULL;
+  sb->length = sb->capacity = 0;
+  if (luaL_newmetatable(L, STRBUF_MT)) {
+    lua_pushcfunction(L, l_tm_strbuf_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+// strbuf_append(builder, ...) appends the string form of each argument
+static int l_tm_strbuf_append (lua_State* L)
+{
+  tm_strbuf_t* sb = (tm_strbuf_t*) luaL_checkudata(L, 1, STRBUF_MT);
+  int top = lua_gettop(L);
+  for (int i = 2; i <= top; i++) {
+    size_t len = 0;
+    const char* str = str_tolstring(L, i, &len);
+    strbuf_reserve(L, sb, len);
+    memcpy(sb->data + sb->length, str, len);
+    sb->length += len;
+    lua_pop(L, 1);
+  }
+  return 0;
+}
+
+// strbuf_tostring(builder) -> contents so far
+static int l_tm_strbuf_tostring (lua_State* L)
+{
+  tm_strbuf_t* sb = (tm_strbuf_t*) luaL_checkudata(L, 1, STRBUF_MT);
+  lua_pushlstring(L, sb->data != NULL ? sb->data : "", sb->length);
+  return 1;
+}
+
+// str_join(arr, len, sep, null) joins arr[0..len) with sep. Elements that
+// are nil or the null sentinel contribute an empty string.
+static int l_tm_str_join (lua_State* L)
+{
+  size_t len = (size_t) lua_tonumber(L, 2);
+  size_t sep_len = 0;
+  const char* sep = lua_tolstring(L, 3, &sep_len);
+
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  for (size_t i = 0; i < len; i++) {
+    if (i > 0 && sep_len > 0) {
+      luaL_addlstring(&b, sep, sep_len);
+    }
+    lua_pushnumber(L, i);
+    lua_gettable(L, 1);
+    if (lua_isnil(L, -1) || lua_rawequal(L, -1, 4)) {
+      lua_pop(L, 1);
+      continue;
+    }
+    if (lua_type(L, -1) != LUA_TSTRING && lua_type(L, -1) != LUA_TNUMBER) {
+      str_tolstring(L, -1, NULL);
+      lua_remove(L, -2);
+    }
+    luaL_addvalue(&b);
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+// str_concat(...) -> the string forms of all arguments, concatenated
+static int l_tm_str_concat (lua_State* L)
+{
+  int top = lua_gettop(L);
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  for (int i = 1; i <= top; i++) {
+    str_tolstring(L, i, NULL);
+    luaL_addvalue(&b);
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+// str_fromcodes(codes, n) -> the string of code units codes[1..n]
+static int l_tm_str_fromcodes (lua_State* L)
+{
+  int n = (int) lua_tonumber(L, 2);
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  for (int i = 1; i <= n; i++) {
+    lua_rawgeti(L, 1, i);
+    uint32_t c = (uint32_t) lua_tonumber(L, -1);
+    lua_pop(L, 1);
+
+    uint8_t buf[4] = { 0 };
+    size_t len = tm_str_fromcode(c, (uint8_t*) &buf);
+    const char* str;
+    size_t str_len = tm_str_from_utf8(buf, len, (const uint8_t**) &str);
+    luaL_addlstring(&b, str, str_len);
+    if (str != (const char*) buf) free((char*) str);
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+
+/**
+ * Arrays
+ *
+ * JS arrays keep element i at raw key i and their length at raw key
+ * "length". These move elements in place without going through
+ * metamethods or Lua's border-based table.insert/table.remove.
+ */
+
+static size_t arr_length (lua_State* L, int index)
+{
+  lua_pushliteral(L, "length");
+  lua_rawget(L, index);
+  lua_Number len = lua_tonumber(L, -1);
+  lua_pop(L, 1);
+  return len > 0 ? (size_t) len : 0;
+}
+
+static void arr_setlength (lua_State* L, int index, size_t len)
+{
+  lua_pushliteral(L, "length");
+  lua_pushnumber(L, len);
+  lua_rawset(L, index);
+}
+
+// Moves count elements starting at from to start at to, handling overlap.
+static void arr_move (lua_State* L, int index, size_t from, size_t to, size_t count)
+{
+  if (to < from) {
+    for (size_t i = 0; i < count; i++) {
+      lua_rawgeti(L, index, from + i);
+      lua_rawseti(L, index, to + i);
+    }
+  } else if (to > from) {
+    for (size_t i = count; i > 0; i--) {
+      lua_rawgeti(L, index, from + i - 1);
+      lua_rawseti(L, index, to + i - 1);
+    }
+  }
+}
+
+static void arr_clear (lua_State* L, int index, size_t from, size_t to)
+{
+  for (size_t i = from; i < to; i++) {
+    lua_pushnil(L);
+    lua_rawseti(L, index, i);
+  }
+}
+
+// arr_shift(arr) -> first element
+static int l_tm_arr_shift (lua_State* L)
+{
+  luaL_checktype(L, 1, LUA_TTABLE);
+  size_t len = arr_length(L, 1);
+  if (len == 0) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  lua_rawgeti(L, 1, 0);
+  arr_move(L, 1, 1, 0, len - 1);
+  arr_clear(L, 1, len - 1, len);
+  arr_setlength(L, 1, len - 1);
+  return 1;
+}
+
+// arr_unshift(arr, ...) -> new length
+static int l_tm_arr_unshift (lua_State* L)
+{
+  luaL_checktype(L, 1, LUA_TTABLE);
+  size_t len = arr_length(L, 1);
+  size_t count = lua_gettop(L) - 1;
+
+  arr_move(L, 1, 0, count, len);
+  for (size_t i = 0; i < count; i++) {
+    lua_pushvalue(L, i + 2);
+    lua_rawseti(L, 1, i);
+  }
+  arr_setlength(L, 1, len + count);
+  lua_pushnumber(L, len + count);
+  return 1;
+}
+
+// arr_splice(arr, start, delete_count, ...) -> removed (0-based), count
+static int l_tm_arr_splice (lua_State* L)
+{
+  luaL_checktype(L, 1, LUA_TTABLE);
+  size_t len = arr_length(L, 1);
+  lua_Number start_arg = lua_tonumber(L, 2);
+  lua_Number del_arg = lua_tonumber(L, 3);
+  size_t start = start_arg < 0 ? 0 : start_arg > len ? len : (size_t) start_arg;
+  size_t del = del_arg < 0 ? 0 : del_arg > len - start ? len - start : (size_t) del_arg;
+  size_t count = lua_gettop(L) > 3 ? lua_gettop(L) - 3 : 0;
+
+  lua_createtable(L, del > 0 ? del - 1 : 0, 1);
+  int removed = lua_gettop(L);
+  for (size_t i = 0; i < del; i++) {
+    lua_rawgeti(L, 1, start + i);
+    lua_rawseti(L, removed, i);
+  }
+
+  size_t tail = len - start - del;
+  arr_move(L, 1, start + del, start + count, tail);
+  if (count < del) {
+    arr_clear(L, 1, len - (del - count), len);
+  }
+  for (size_t i = 0; i < count; i++) {
+    lua_pushvalue(L, i + 4);
+    lua_rawseti(L, 1, start + i);
+  }
+  arr_setlength(L, 1, len - del + count);
+
+  lua_pushnumber(L, del);
+  return 2;
+}
+
+
+// Stable merge sort over element positions. Runs of ARR_SORT_RUN are
+// insertion sorted, then merged bottom-up; merges of runs that are already
+// in order are skipped, so presorted input costs a single pass.
+#define ARR_SORT_RUN 16
+
+typedef struct {
+  const char* str;
+  size_t len;
+} arr_sort_key_t;
+
+typedef struct {
+  lua_State* L;
+  int values;
+  int fn;
+  int self;
+  const arr_sort_key_t* keys;
+} arr_sort_t;
+
+// Returns true if element a belongs after element b.
+static int arr_sort_after (arr_sort_t* s, int a, int b)
+{
+  if (s->keys != NULL) {
+    const arr_sort_key_t* ka = &s->keys[a];
+    const arr_sort_key_t* kb = &s->keys[b];
+    int cmp = memcmp(ka->str, kb->str, ka->len < kb->len ? ka->len : kb->len);
+    return cmp > 0 || (cmp == 0 && ka->len > kb->len);
+  }
+
+  lua_State* L = s->L;
+  lua_pushvalue(L, s->fn);
+  lua_pushvalue(L, s->self);
+  lua_rawgeti(L, s->values, a);
+  lua_rawgeti(L, s->values, b);
+  lua_call(L, 3, 1);
+  int after = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : lua_tonumber(L, -1) > 0;
+  lua_pop(L, 1);
+  return after;
+}
+
+static void arr_sort_merge (arr_sort_t* s, int* a, int* tmp, size_t lo, size_t mid, size_t hi)
+{
+  if (!arr_sort_after(s, a[mid - 1], a[mid])) {
+    return;
+  }
+  memcpy(&tmp[lo], &a[lo], (mid - lo) * sizeof(int));
+  size_t i = lo, j = mid, k = lo;
+  while (i < mid && j < hi) {
+    a[k++] = arr_sort_after(s, tmp[i], a[j]) ? a[j++] : tmp[i++];
+  }
+  while (i < mid) {
+    a[k++] = tmp[i++];
+  }
+}
+
+static void arr_sort_run (arr_sort_t* s, int* a, size_t count)
+{
+  int* tmp = (int*) lua_newuserdata(s->L, count * sizeof(int));
+
+  for (size_t lo = 0; lo < count; lo += ARR_SORT_RUN) {
+    size_t hi = lo + ARR_SORT_RUN < count ? lo + ARR_SORT_RUN : count;
+    for (size_t i = lo + 1; i < hi; i++) {
+      int x = a[i];
+      size_t j = i;
+      while (j > lo && arr_sort_after(s, a[j - 1], x)) {
+        a[j] = a[j - 1];
+        j--;
+      }
+      a[j] = x;
+    }
+  }
+
+  for (size_t width = ARR_SORT_RUN; width < count; width *= 2) {
+    for (size_t lo = 0; lo + width < count; lo += 2 * width) {
+      size_t hi = lo + 2 * width < count ? lo + 2 * width : count;
+      arr_sort_merge(s, a, tmp, lo, lo + width, hi);
+    }
+  }
+
+  lua_pop(s->L, 1);
+}
+
+// arr_sort(arr, [fn]) sorts in place. Without fn, elements are ordered by
+// their string forms, computed once each. undefined always sorts last.
+static int l_tm_arr_sort (lua_State* L)
+{
+  luaL_checktype(L, 1, LUA_TTABLE);
+  size_t len = arr_length(L, 1);
+  int has_fn = lua_isfunction(L, 2);
+
+  // Copy out the defined elements, 1-based.
+  lua_createtable(L, len, 0);
+  int values = lua_gettop(L);
+  size_t count = 0;
+  for (size_t i = 0; i < len; i++) {
+    lua_rawgeti(L, 1, i);
+    if (lua_isnil(L, -1)) {
+      lua_pop(L, 1);
+    } else {
+      lua_rawseti(L, values, ++count);
+    }
+  }
+
+  int* order = (int*) lua_newuserdata(L, (count + 1) * sizeof(int));
+  for (size_t i = 0; i <= count; i++) {
+    order[i] = i;
+  }
+
+  arr_sort_t s = { L, values, 2, 1, NULL };
+  if (!has_fn && count > 1) {
+    // Keys stay reachable through the keys table while sorting.
+    arr_sort_key_t* keys = (arr_sort_key_t*) lua_newuserdata(L, (count + 1) * sizeof(arr_sort_key_t));
+    lua_createtable(L, count, 0);
+    int key_strs = lua_gettop(L);
+    for (size_t i = 1; i <= count; i++) {
+      lua_rawgeti(L, values, i);
+      str_tolstring(L, -1, &keys[i].len);
+      keys[i].str = lua_tostring(L, -1);
+      lua_rawseti(L, key_strs, i);
+      lua_pop(L, 1);
+    }
+    s.keys = keys;
+  }
+  if (count > 1) {
+    arr_sort_run(&s, &order[1], count);
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    if (i < count) {
+      lua_rawgeti(L, values, order[i + 1]);
+    } else {
+      lua_pushnil(L);
+    }
+    lua_rawseti(L, 1, i);
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+#ifdef ENABLE_NET
+
+// dns_lookup(domain, callback) -> rc
+static int l_tm_dns_lookup (lua_State* L)
 {
   const char *host = colony_toutf8(L, 1);
+  lua_settop(L, 2);
+  int callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
 
-  lua_pushnumber(L, tm__sync_gethostbyname(host));
+  lua_pushnumber(L, tm_dns_lookup(host, callback_ref));
   return 1;
 }
 
@@ -1286,13 +2121,130 @@ static int l_tm_approxidate_milli (lua_State *L)
 }
 
 
+/**
+ * JSON stream
+ */
+
+#define JSON_STREAM_MT "tm_json_stream"
+
+typedef struct {
+  lua_State* L;
+  tm_json_stream_t* stream;
+  int values;
+  size_t count;
+  size_t err_offset;
+  int parse_failed;
+} json_stream_emit_t;
+
+// Parses each complete value in place into the values table.
+static int json_stream_value (void* state, const char* value, size_t len)
+{
+  json_stream_emit_t* e = (json_stream_emit_t*) state;
+  parse_error_t err;
+  if (lua_rapidjson_read(e->L, value, len, &err) != 0) {
+    e->err_offset = e->stream->value_offset + err.offset;
+    e->parse_failed = 1;
+    return TM_JSON_STREAM_ESYNTAX;
+  }
+  lua_rawseti(e->L, e->values, e->count++);
+  return 0;
+}
+
+static void json_stream_emit_init (lua_State* L, json_stream_emit_t* e, tm_json_stream_t* stream)
+{
+  lua_createtable(L, 0, 0);
+  e->L = L;
+  e->stream = stream;
+  e->values = lua_gettop(L);
+  e->count = 0;
+  e->err_offset = 0;
+  e->parse_failed = 0;
+}
+
+// (values) -> (values, count, err)
+static int json_stream_result (lua_State* L, json_stream_emit_t* e, int r)
+{
+  lua_pushnumber(L, e->count);
+  switch (r) {
+    case 0:
+      lua_pushnil(L);
+      break;
+    case TM_JSON_STREAM_EEND:
+      lua_pushliteral(L, "Unexpected end of input");
+      break;
+    case TM_JSON_STREAM_EDEPTH:
+      lua_pushliteral(L, "JSON nested too deeply");
+      break;
+    case TM_JSON_STREAM_ENOMEM:
+      lua_pushliteral(L, "JSON stream out of memory");
+      break;
+    default:
+      lua_pushfstring(L, "Unexpected token at position %d", (int) (e->parse_failed ? e->err_offset : e->stream->offset));
+      break;
+  }
+  return 3;
+}
+
+static int l_tm_json_stream_gc (lua_State* L)
+{
+  tm_json_stream_t* stream = (tm_json_stream_t*) luaL_checkudata(L, 1, JSON_STREAM_MT);
+  tm_json_stream_free(stream);
+  return 0;
+}
+
+// json_stream_create([path]) -> stream
+static int l_tm_json_stream_create (lua_State* L)
+{
+  size_t path_len = 0;
+  const char* path = lua_isstring(L, 1) ? lua_tolstring(L, 1, &path_len) : "";
+
+  tm_json_stream_t* stream = (tm_json_stream_t*) lua_newuserdata(L, sizeof(tm_json_stream_t));
+  if (tm_json_stream_init(stream, path, path_len) != 0) {
+    return luaL_error(L, "JSON stream path is too long");
+  }
+  if (luaL_newmetatable(L, JSON_STREAM_MT)) {
+    lua_pushcfunction(L, l_tm_json_stream_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+// json_stream_write(stream, buf|str) -> values, count, err
+static int l_tm_json_stream_write (lua_State* L)
+{
+  tm_json_stream_t* stream = (tm_json_stream_t*) luaL_checkudata(L, 1, JSON_STREAM_MT);
+  size_t len = 0;
+  const char* data = (const char*) colony_toconstdata(L, 2, &len);
+  if (data == NULL) {
+    data = str_tolstring(L, 2, &len);
+  }
+
+  json_stream_emit_t e;
+  json_stream_emit_init(L, &e, stream);
+  int r = tm_json_stream_write(stream, data, len, json_stream_value, &e);
+  return json_stream_result(L, &e, r);
+}
+
+// json_stream_end(stream) -> values, count, err
+static int l_tm_json_stream_end (lua_State* L)
+{
+  tm_json_stream_t* stream = (tm_json_stream_t*) luaL_checkudata(L, 1, JSON_STREAM_MT);
+
+  json_stream_emit_t e;
+  json_stream_emit_init(L, &e, stream);
+  int r = tm_json_stream_end(stream, json_stream_value, &e);
+  return json_stream_result(L, &e, r);
+}
+
+
 /**
  * Random
  */
 
 static int l_tm_random_bytes (lua_State *L)
 {
-  uint8_t *a = (uint8_t *) lua_touserdata(L, 1);
+  uint8_t *a = colony_tobuffer(L, 1, NULL);
   size_t start = (size_t) lua_tonumber(L, 2);
   size_t end = (size_t) lua_tonumber(L, 3);
 
@@ -1303,6 +2255,34 @@ static int l_tm_random_bytes (lua_State *L)
   return 2;
 }
 
+
+/**
+ * Content hash
+ */
+
+// 64-bit FNV-1a of a string, as 16 hex digits. Not cryptographic; used to key
+// caches by content, so it is available even without TLS.
+static int l_tm_hash_fnv1a (lua_State *L)
+{
+  size_t len = 0;
+  const uint8_t* str = (const uint8_t*) luaL_checklstring(L, 1, &len);
+
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= str[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  char hex[17];
+  static const char digits[] = "0123456789abcdef";
+  for (int i = 15; i >= 0; i--) {
+    hex[i] = digits[hash & 0xf];
+    hash >>= 4;
+  }
+  lua_pushlstring(L, hex, 16);
+  return 1;
+}
+
 #ifdef ENABLE_TLS
 
 static int l_tm_hmac_sha1 (lua_State *L)
@@ -1406,6 +2386,7 @@ LUALIB_API int luaopen_tm (lua_State *L)
     { "tcp_connect", l_tm_tcp_connect },
     { "tcp_write", l_tm_tcp_write },
     { "tcp_read", l_tm_tcp_read },
+    { "tcp_read_into", l_tm_tcp_read_into },
     { "tcp_readable", l_tm_tcp_readable },
     { "tcp_listen", l_tm_tcp_listen },
     { "tcp_accept", l_tm_tcp_accept },
@@ -1418,6 +2399,7 @@ LUALIB_API int luaopen_tm (lua_State *L)
     { "ssl_session_altname", l_tm_ssl_session_altname },
     { "ssl_session_cn", l_tm_ssl_session_cn },
     { "ssl_session_free", l_tm_ssl_session_free },
+    { "ssl_session_stats", l_tm_ssl_session_stats },
     { "ssl_writeable", l_tm_ssl_writeable },
     { "ssl_write", l_tm_ssl_write },
     { "ssl_read", l_tm_ssl_read },
@@ -1431,14 +2413,34 @@ LUALIB_API int luaopen_tm (lua_State *L)
     { "set_raw_timeout", l_tm_set_raw_timeout },
     { "clear_raw_timeout", l_tm_clear_raw_timeout },
 
+    // immediates
+    { "set_immediate", l_tm_set_immediate },
+    { "clear_immediate", l_tm_clear_immediate },
+    { "next_tick", l_tm_next_tick },
+
+    // watchers
+    { "fd_watch", l_tm_fd_watch },
+    { "fd_unwatch", l_tm_fd_unwatch },
+
     // buffer
     { "buffer_create", l_tm_buffer_create },
-    { "buffer_index", l_tm_buffer_index },
+    { "buffer_slice", l_tm_buffer_slice },
+    { "buffer_metatable", l_tm_buffer_metatable },
+    { "buffer_length", l_tm_buffer_length },
     { "buffer_set", l_tm_buffer_set },
     { "buffer_get", l_tm_buffer_get },
     { "buffer_fill", l_tm_buffer_fill },
     { "buffer_copy", l_tm_buffer_copy },
     { "buffer_tobytestring", l_tm_buffer_tobytestring },
+    { "buffer_from_string", l_tm_buffer_from_string },
+    { "buffer_from_array", l_tm_buffer_from_array },
+    { "buffer_from_hex", l_tm_buffer_from_hex },
+    { "buffer_tohex", l_tm_buffer_tohex },
+    { "buffer_toarray", l_tm_buffer_toarray },
+
+    // base64
+    { "base64_encode", l_tm_base64_encode },
+    { "base64_decode", l_tm_base64_decode },
     { "buffer_read_uint8", l_tm_buffer_read_uint8 },
     { "buffer_read_uint16le", l_tm_buffer_read_uint16le },
     { "buffer_read_uint16be", l_tm_buffer_read_uint16be },
@@ -1497,6 +2499,20 @@ LUALIB_API int luaopen_tm (lua_State *L)
     { "str_fromcode", l_tm_str_fromcode },
     { "str_lookup_JsToLua", l_tm_str_lookup_JsToLua },
     { "str_lookup_LuaToJs", l_tm_str_lookup_LuaToJs },
+    { "str_join", l_tm_str_join },
+    { "str_concat", l_tm_str_concat },
+    { "str_fromcodes", l_tm_str_fromcodes },
+
+    // string builder
+    { "strbuf_create", l_tm_strbuf_create },
+    { "strbuf_append", l_tm_strbuf_append },
+    { "strbuf_tostring", l_tm_strbuf_tostring },
+
+    // arrays
+    { "arr_shift", l_tm_arr_shift },
+    { "arr_unshift", l_tm_arr_unshift },
+    { "arr_splice", l_tm_arr_splice },
+    { "arr_sort", l_tm_arr_sort },
     
     // deflate
     { "deflate_start", l_tm_deflate_start },
@@ -1508,11 +2524,17 @@ LUALIB_API int luaopen_tm (lua_State *L)
     { "inflate_write", l_tm_inflate_write },
     { "inflate_end", l_tm_inflate_end },
 
+    // json stream
+    { "json_stream_create", l_tm_json_stream_create },
+    { "json_stream_write", l_tm_json_stream_write },
+    { "json_stream_end", l_tm_json_stream_end },
+
     // Approxidate
     {"approxidate_milli", l_tm_approxidate_milli },
 
     // random
     { "random_bytes", l_tm_random_bytes },
+    { "hash_fnv1a", l_tm_hash_fnv1a },
 
     // TLS
 #ifdef ENABLE_TLS
@@ -1536,7 +2558,7 @@ LUALIB_API int luaopen_tm (lua_State *L)
     { "paramname", l_tm_paramname },
 
 #ifdef ENABLE_NET
-    { "_sync_gethostbyname", l_tm__sync_gethostbyname },
+    { "dns_lookup", l_tm_dns_lookup },
 #endif
 
     { NULL, NULL }
@@ -1547,7 +2569,14 @@ LUALIB_API int luaopen_tm (lua_State *L)
   luaL_setfieldnumber(L, "GZIP", TM_GZIP);
   luaL_setfieldnumber(L, "UNZIP", TM_UNZIP);
 
+  luaL_setfieldnumber(L, "FD_READABLE", TM_FD_READABLE);
+  luaL_setfieldnumber(L, "FD_WRITABLE", TM_FD_WRITABLE);
+
   luaL_setfieldnumber(L, "ENETUNREACH", ENETUNREACH);
+  luaL_setfieldnumber(L, "EAGAIN", EAGAIN);
+  luaL_setfieldnumber(L, "EWOULDBLOCK", EWOULDBLOCK);
+  luaL_setfieldnumber(L, "ECONNRESET", ECONNRESET);
+  luaL_setfieldnumber(L, "ETIMEDOUT", ETIMEDOUT);
   luaL_setfieldnumber(L, "ENOTCONN", CC_ENOTCONN);
 
   luaL_setfieldnumber(L, "FS_TYPE_INVALID", TM_FS_TYPE_INVALID);
@@ -51,14 +51,13 @@ UDP.prototype.bind = function (port, addr, cb) {
   }
   
   this._boundPort = port;
-  this._listenid = setTimeout(function poll () {
-    self._listenid = null;
+
+  function receive () {
     if (self._fd == null) {
       return;
     }
 
-    var r;
-    while ((r = tm.udp_readable(self._fd))) {
+    while (tm.udp_readable(self._fd)) {
       var ret = tm.udp_receive(self._fd),
           msg = ret[0],
           addr = ret[1],
@@ -69,8 +68,21 @@ UDP.prototype.bind = function (port, addr, cb) {
         port: port
       });
     }
-    self._listenid = setTimeout(poll);
-  }, 100);
+  }
+
+  if (tm.fd_watch(this._fd, tm.FD_READABLE, receive) == 0) {
+    this._watching = true;
+  } else {
+    // the platform can't watch this socket, so poll it instead
+    this._listenid = setTimeout(function poll () {
+      self._listenid = null;
+      if (self._fd == null) {
+        return;
+      }
+      receive();
+      self._listenid = setTimeout(poll);
+    }, 100);
+  }
   
   setImmediate(function () {
     cb && cb();
@@ -124,6 +136,10 @@ UDP.prototype.send = function (text, offset, len, port, host, cb) {
 
 UDP.prototype.close = function () {
   if (this._closed) return;
+  if (this._watching) {
+    tm.fd_unwatch(this._fd);
+    this._watching = false;
+  }
   tm.udp_close(this._fd);
   this._fd = null;
   this._closed = true;
@@ -8,6 +8,159 @@
 // except according to those terms.
 var tm = process.binding('tm');
 
+function errnoException (code, syscall, hostname) {
+  var err = new Error(syscall + ' ' + code);
+  err.code = err.errno = code;
+  err.syscall = syscall;
+  if (hostname) {
+    err.hostname = hostname;
+  }
+  return err;
+}
+
+function toDotted (ipl) {
+  return [(ipl >> 24) & 0xFF, (ipl >> 16) & 0xFF, (ipl >> 8) & 0xFF, (ipl >> 0) & 0xFF].join('.');
+}
+
+// Answers are kept for their record TTL (at most maxTtl seconds), and names
+// that don't exist for negativeTtl seconds. Once there are more than
+// maxEntries names, the least recently used is dropped. Concurrent lookups
+// of one name share a query.
+var cacheOptions = {
+  maxEntries: 64,
+  maxTtl: 3600,
+  negativeTtl: 30
+};
+
+var cache = {}, cacheSize = 0, cacheClock = 0;
+var pending = {};
+var cacheStats = { hits: 0, misses: 0 };
+
+function cacheTrim () {
+  while (cacheSize > Math.max(cacheOptions.maxEntries, 0)) {
+    var oldest = null;
+    for (var k in cache) {
+      if (oldest == null || cache[k].used < cache[oldest].used) {
+        oldest = k;
+      }
+    }
+    delete cache[oldest];
+    cacheSize--;
+  }
+}
+
+function cacheStore (key, err, ips, ttl) {
+  if (err) {
+    ttl = (err == 'ENOTFOUND' || err == 'ENODATA') ? cacheOptions.negativeTtl : 0;
+  } else {
+    ttl = Math.min(ttl, cacheOptions.maxTtl);
+  }
+  if (!(ttl > 0) || cacheOptions.maxEntries <= 0) {
+    return;
+  }
+
+  if (!cache[key]) {
+    cacheSize++;
+  }
+  cache[key] = { err: err, ips: ips, expires: Date.now() + ttl * 1000, used: ++cacheClock };
+  cacheTrim();
+}
+
+function answer (waiting, domain, err, ips) {
+  waiting.forEach(function (w) {
+    if (err) {
+      w.callback(errnoException(err, w.syscall, domain));
+    } else {
+      w.callback(null, ips.slice());
+    }
+  });
+}
+
+// Queries run on a shared c-ares channel driven by the event loop; the
+// callback is always called asynchronously.
+function query (domain, syscall, callback) {
+  var key = '$' + String(domain).toLowerCase();
+
+  var entry = cache[key];
+  if (entry && entry.expires > Date.now()) {
+    cacheStats.hits++;
+    entry.used = ++cacheClock;
+    return setImmediate(function () {
+      answer([{ syscall: syscall, callback: callback }], domain, entry.err, entry.ips);
+    });
+  }
+  if (entry) {
+    delete cache[key];
+    cacheSize--;
+  }
+
+  if (pending[key]) {
+    cacheStats.hits++;
+    pending[key].push({ syscall: syscall, callback: callback });
+    return;
+  }
+
+  cacheStats.misses++;
+  pending[key] = [{ syscall: syscall, callback: callback }];
+  var ret = tm.dns_lookup(domain, function (err, ips, ttl) {
+    var waiting = pending[key];
+    delete pending[key];
+    ips = err ? null : ips.map(toDotted);
+    cacheStore(key, err, ips, ttl);
+    answer(waiting, domain, err, ips);
+  });
+  if (ret != 0) {
+    setImmediate(function () {
+      var waiting = pending[key];
+      delete pending[key];
+      answer(waiting, domain, 'ENETUNREACH');
+    });
+  }
+}
+
+// Changes any of maxEntries, maxTtl (seconds), and negativeTtl (seconds).
+exports.setCacheOptions = function (options) {
+  for (var k in cacheOptions) {
+    if (options && typeof options[k] == 'number') {
+      cacheOptions[k] = options[k];
+    }
+  }
+  cacheTrim();
+};
+
+exports.getCacheOptions = function () {
+  return { maxEntries: cacheOptions.maxEntries, maxTtl: cacheOptions.maxTtl, negativeTtl: cacheOptions.negativeTtl };
+};
+
+exports.getCacheStats = function () {
+  return { hits: cacheStats.hits, misses: cacheStats.misses, size: cacheSize };
+};
+
+exports.clearCache = function () {
+  cache = {};
+  cacheSize = 0;
+};
+
+exports.lookup = function (domain, family, callback) {
+  if (typeof family == 'function') {
+    callback = family;
+    family = 0;
+  }
+
+  if (!domain) {
+    return setImmediate(function () {
+      callback(null, null, 4);
+    });
+  }
+
+  query(domain, 'getaddrinfo', function (err, ips) {
+    if (err) {
+      return callback(err);
+    }
+    callback(null, ips[0], 4);
+  });
+};
+
 exports.resolve = function (domain, type, callback) {
   if (typeof type == 'function') {
     callback = type;
@@ -16,20 +169,11 @@ exports.resolve = function (domain, type, callback) {
 
   // TODO use type
 
-  var tries = 3;
-  setImmediate(function poll () {
-    // CC3000 can flake with cares. Three time's the charm.
-  	var ipl = tm._sync_gethostbyname(domain);
-  	if (ipl == 0) {
-      tries--;
-      if (tries > 0) {
-        return poll();
-      }
-  		callback(new Error('ENOENT'));
-  	} else {
-    	callback(null, [[(ipl >> 24) & 0xFF, (ipl >> 16) & 0xFF, (ipl >> 8) & 0xFF, (ipl >> 0) & 0xFF].join('.')])
-    }
-  });
-}
+  query(domain, 'queryA', callback);
+};
+
+exports.resolve4 = function (domain, callback) {
+  query(domain, 'queryA', callback);
+};
 
-// TODO the rest!
\ No newline at end of file
+// TODO the rest!
@@ -0,0 +1,58 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+// Streaming JSON parser. Buffers or strings are written in, and each value
+// at the selected path is pushed out as soon as it is complete:
+//
+//   res.pipe(require('json_stream').parse('rows.*')).on('data', ...)
+//
+// With no path, every top-level value is emitted (newline-delimited JSON).
+// Path segments are separated by '.', and '*' matches any key or index.
+// Only the value currently being read is held in memory.
+
+var tm = process.binding('tm');
+var Transform = require('stream').Transform;
+var util = require('util');
+
+function JSONStream (path) {
+  if (!(this instanceof JSONStream)) {
+    return new JSONStream(path);
+  }
+  Transform.call(this, { objectMode: true });
+  this._parser = tm.json_stream_create(path == null ? '' : String(path));
+}
+
+util.inherits(JSONStream, Transform);
+
+// json_stream_write and json_stream_end return (values, count, err). JSON
+// null is read as undefined, which would end the stream, so it is not pushed.
+JSONStream.prototype._emitValues = function (values, count, err, callback) {
+  for (var i = 0; i < count; i++) {
+    if (values[i] !== undefined) {
+      this.push(values[i]);
+    }
+  }
+  callback(err ? new SyntaxError(err) : null);
+};
+
+JSONStream.prototype._transform = function (chunk, encoding, callback) {
+  var _ = tm.json_stream_write(this._parser, chunk);
+  this._emitValues(_[0], _[1], _[2], callback);
+};
+
+JSONStream.prototype._flush = function (callback) {
+  var _ = tm.json_stream_end(this._parser);
+  this._emitValues(_[0], _[1], _[2], callback);
+};
+
+exports.JSONStream = JSONStream;
+
+exports.parse = function (path) {
+  return new JSONStream(path);
+};
@@ -171,6 +171,7 @@ TCPSocket.prototype.connect = function (/*options | [port], [host], [cb]*/) {
         self.emit('error', new Error(err));
 
         // cleanup
+        self.__releaseSSL();
         self.removeAllListeners();
       });
 
@@ -285,6 +286,7 @@ TCPSocket.prototype.connect = function (/*options | [port], [host], [cb]*/) {
           };
 
           if (self._ssl_checkCerts && !tls.checkServerIdentity(host, self._ssl_cert)) {
+            tm.ssl_session_free(ssl);
             return self.emit('error', new Error('Hostname/IP doesn\'t match certificate\'s altnames'));
           }
 
@@ -312,11 +314,23 @@ TCPSocket.prototype.connect = function (/*options | [port], [host], [cb]*/) {
 };
 
 TCPSocket.prototype._read = function (size) {
-  // TODO: start polling it again
+  // the consumer wants more data, so resume reading if push() had asked us to stop
+  if (this.__paused && this.socket != null) {
+    this.__paused = false;
+    this.__listen();
+  }
 }
 
 TCPSocket.prototype.__listen = function () {
   var self = this;
+  if (tm.fd_watch(this.socket, tm.FD_READABLE, function () {
+    self.__onReadable();
+  }) == 0) {
+    this.__watching = true;
+    return;
+  }
+
+  // the platform can't watch this socket, so poll it instead
   this.__listenid = setTimeout(function loop () {
     self.__listenid = null;
     // ~HACK: set a watchdog to fire end event if not re-polled
@@ -333,11 +347,66 @@ TCPSocket.prototype.__listen = function () {
       return;
     }
 
-    self.__listenid = setTimeout(loop, 10);
+    if (!self.__paused) {
+      self.__listenid = setTimeout(loop, 10);
+    }
     clearImmediate(failsafeEnd);
   }, 10);
 };
 
+TCPSocket.prototype.__unlisten = function () {
+  if (this.__watching) {
+    tm.fd_unwatch(this.socket);
+    this.__watching = false;
+  }
+  if (this.__listenid != null) {
+    clearTimeout(this.__listenid);
+    this.__listenid = null;
+  }
+};
+
+// Most bytes drained from the socket per readiness event.
+var READ_BUFFER_SIZE = 64 * 1024;
+
+// Called by the event loop each time the socket becomes readable.
+TCPSocket.prototype.__onReadable = function () {
+  if (this.socket == null) return;
+
+  var _ = this._ssl ? tm.ssl_read(this._ssl) : tm.tcp_read(this.socket, READ_BUFFER_SIZE)
+    , data = _[0]
+    , err = _[1];
+
+  if (data && data.length) {
+    this._restartTimeout();
+    if (!this.push(data)) {
+      // stop reading until _read is called again
+      this.__paused = true;
+      this.__unlisten();
+    }
+  } else if (!this._ssl && err != 0 && err != tm.EAGAIN && err != tm.EWOULDBLOCK) {
+    // a failed read (e.g. reset by the peer) is not a clean end
+    this.__unlisten();
+    this.emit('error', readError(err));
+    this.destroy();
+  } else if (this._ssl ? err < 0 : err == 0) {
+    // readable without any data: the connection is gone
+    this.__unlisten();
+    this.close();
+  }
+};
+
+function readError (errno) {
+  var code = errno == tm.ECONNRESET ? 'ECONNRESET'
+    : errno == tm.ETIMEDOUT ? 'ETIMEDOUT'
+    : errno == tm.ENOTCONN ? 'ENOTCONN'
+    : 'EIO';
+  var err = new Error('read ' + code);
+  err.code = code;
+  err.errno = errno;
+  err.syscall = 'read';
+  return err;
+}
+
 TCPSocket.prototype.localFamily = 'IPv4';
 TCPSocket.prototype.remoteFamily = 'IPv4';
 
@@ -421,9 +490,9 @@ TCPSocket.prototype.__readSocket = function(restartTimeout) {
   var arr = [], flag = 0;
   while (self.socket != null && (flag = tm.tcp_readable(self.socket)) > 0) {
     if (self._ssl) {
-      var data = tm.ssl_read(self._ssl);
+      var data = tm.ssl_read(self._ssl)[0];
     } else {
-      var data = tm.tcp_read(self.socket);
+      var data = tm.tcp_read(self.socket, READ_BUFFER_SIZE)[0];
     }
     if (!data || data.length == 0) {
       break;
@@ -439,8 +508,11 @@ TCPSocket.prototype.__readSocket = function(restartTimeout) {
     }
 
     var buf = Buffer.concat(arr);
-    // TODO: stop polling if this returns false
-    self.push(buf);
+    if (!self.push(buf)) {
+      // stop reading until _read is called again
+      self.__paused = true;
+      self.__unlisten();
+    }
   }
 
   return flag;
@@ -454,6 +526,8 @@ TCPSocket.prototype.__close = function (tryToClose) {
 
   var self = this;
   process.removeListener('tcp-close', this._closehandler);
+  this.__unlisten();
+  this.__releaseSSL();
 
   var retries = 0;
   function closeSocket(){
@@ -482,6 +556,19 @@ TCPSocket.prototype.__close = function (tryToClose) {
   }
 }
 
+// TLS contexts are shared between sockets, so each socket gives up its
+// reference when it closes.
+TCPSocket.prototype.__releaseSSL = function () {
+  if (this._ssl) {
+    tm.ssl_session_free(this._ssl);
+    this._ssl = null;
+  }
+  if (this._ssl_ctx) {
+    tm.ssl_context_free(this._ssl_ctx);
+    this._ssl_ctx = null;
+  }
+};
+
 TCPSocket.prototype.destroy = TCPSocket.prototype.close = function () {
   if (this._destroy) return;
 
@@ -489,10 +576,7 @@ TCPSocket.prototype.destroy = TCPSocket.prototype.close = function () {
   
   var self = this;
   setImmediate(function () {
-    if (self.__listenid != null) {
-      clearInterval(self.__listenid);
-      self.__listenid = null;
-    }
+    self.__unlisten();
     self.emit('end')
     if (self.socket != null) {
       // if there is still data left, wait until its sent before we end
@@ -590,19 +674,26 @@ TCPServer.prototype.listen = function (port, host, backlog, cb) {
     self.emit('error', new Error("Listen on TCP socket failed ("+res+")"));
   }); else setImmediate(function () {
     self.emit('listening');
-    poll();
+    if (tm.fd_watch(self.socket, tm.FD_READABLE, accept) == 0) {
+      self.__watching = true;
+    } else {
+      // the platform can't watch this socket, so poll it instead
+      poll();
+    }
   });
-  
-  function poll(){
-    // stop polling if we get closed
+
+  function accept(){
+    // stop accepting if we get closed
     if (self.socket === null) return;
-    
-    var _ = tm.tcp_accept(self.socket)
-      , client = _[0]
-      , addr = _[1]
-      , port = _[2];
 
-    if (client >= 0) {
+    while (true) {
+      var _ = tm.tcp_accept(self.socket)
+        , client = _[0]
+        , addr = _[1]
+        , port = _[2];
+
+      if (client < 0) break;
+
       var clientsocket = new TCPSocket(client);
       clientsocket.connected = true;
       clientsocket.localAddress = self.localAddress;    // TODO: https://forums.tessel.io/t/get-ip-address-of-tessel-in-code/203
@@ -612,7 +703,13 @@ TCPServer.prototype.listen = function (port, host, backlog, cb) {
       clientsocket.__listen();
       self.emit('connection', clientsocket);
     }
+  }
+
+  function poll(){
+    // stop polling if we get closed
+    if (self.socket === null) return;
 
+    accept();
     setTimeout(poll, 10);
   }
   return this;
@@ -7,6 +7,7 @@
 // option. This file may not be copied, modified, or distributed
 // except according to those terms.
 
+var tm = process.binding('tm');
 var net = require('net');
 var util = require('util');
 
@@ -153,3 +154,10 @@ exports.Server = NotImplementedException;
 exports.CryptoStream = NotImplementedException;
 exports.CleartextStream = NotImplementedException;
 exports.checkServerIdentity = checkServerIdentity;
+
+// Sessions are resumed automatically for hosts connected to recently;
+// hits are resumed handshakes and misses are full ones.
+exports.getSessionStats = function () {
+  var _ = tm.ssl_session_stats();
+  return { hits: _[0], misses: _[1] };
+};
@@ -168,7 +168,8 @@ int tm_tcp_write (tm_socket_t sock, const uint8_t *buf, size_t *buf_len)
 
 int tm_tcp_read (tm_socket_t sock, uint8_t *buf, size_t *buf_len)
 {
-    ssize_t res = recv(sock, buf, *buf_len, 0);
+    // Never block the event loop; an empty socket reports EAGAIN instead.
+    ssize_t res = recv(sock, buf, *buf_len, MSG_DONTWAIT);
     if (res < 0) {
       *buf_len = 0;
       return errno;
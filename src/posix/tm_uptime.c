@@ -14,6 +14,9 @@
 #include <poll.h>
 #include <unistd.h>
 #include <signal.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 
 #include <lua.h>
 
@@ -45,12 +48,102 @@ static void wait_alarm (int dummy)
 	(void) dummy;
 }
 
+/**
+ * Readiness
+ */
+
+/// Registered watches. On Linux these are also held by an epoll set, which is
+/// itself polled alongside stdin; elsewhere each one gets a pollfd entry.
+static tm_fd_watch* fd_watch_head = NULL;
+static size_t fd_watch_count = 0;
+
+#ifdef __linux__
+static int epoll_fd = -1;
+
+static uint32_t fd_flags_to_epoll (unsigned flags)
+{
+	return ((flags & TM_FD_READABLE) ? EPOLLIN : 0) | ((flags & TM_FD_WRITABLE) ? EPOLLOUT : 0);
+}
+#endif
+
+static bool fd_watch_registered (tm_fd_watch* watch)
+{
+	for (tm_fd_watch* w = fd_watch_head; w; w = w->next) {
+		if (w == watch) return true;
+	}
+	return false;
+}
+
+int tm_fd_register (tm_fd_watch* watch, tm_socket_t fd, unsigned flags)
+{
+	bool registered = fd_watch_registered(watch);
+
+#ifdef __linux__
+	if (epoll_fd < 0) {
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_fd < 0) {
+			return -errno;
+		}
+	}
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = fd_flags_to_epoll(flags);
+	ev.data.ptr = watch;
+	if (epoll_ctl(epoll_fd, registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) != 0) {
+		return -errno;
+	}
+#endif
+
+	watch->fd = fd;
+	watch->flags = flags;
+	watch->ready = 0;
+	if (!registered) {
+		watch->next = fd_watch_head;
+		fd_watch_head = watch;
+		fd_watch_count++;
+	}
+	return 0;
+}
+
+int tm_fd_unregister (tm_fd_watch* watch)
+{
+	tm_fd_watch** p = &fd_watch_head;
+	while (*p && *p != watch) {
+		p = &(*p)->next;
+	}
+	if (*p == NULL) {
+		return -ENOENT;
+	}
+	*p = watch->next;
+	watch->next = NULL;
+	fd_watch_count--;
+
+#ifdef __linux__
+	// Fails harmlessly if the descriptor was already closed.
+	struct epoll_event ev;
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, watch->fd, &ev);
+#endif
+	return 0;
+}
+
+static void fd_watch_ready (tm_fd_watch* watch, unsigned ready)
+{
+	if (ready != 0) {
+		watch->ready = ready;
+		tm_event_trigger(&watch->event);
+	}
+}
+
 void hw_wait_for_event()
 {
 	if (tm_lua_state == NULL) return;
 
 	unsigned ms = 10000;
-	if (tm_timer_waiting()) {
+	if (tm_events_pending()) {
+		// Don't sleep on work that is already queued.
+		ms = 0;
+	} else if (tm_timer_waiting()) {
 		unsigned base = tm_timer_base_time();
 		unsigned step = tm_timer_head_time();
 
@@ -63,28 +156,73 @@ void hw_wait_for_event()
 		}
 	}
 
-	struct pollfd fd;
-	fd.fd = STDIN_FILENO;
-	fd.events = POLLIN;
-	fd.revents = 0;
+#ifdef __linux__
+	size_t nfds = epoll_fd < 0 ? 1 : 2;
+#else
+	size_t nfds = 1 + fd_watch_count;
+#endif
+	struct pollfd fds[nfds];
+	fds[0].fd = STDIN_FILENO;
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+
+#ifdef __linux__
+	if (nfds > 1) {
+		fds[1].fd = epoll_fd;
+		fds[1].events = POLLIN;
+		fds[1].revents = 0;
+	}
+#else
+	size_t i = 1;
+	for (tm_fd_watch* w = fd_watch_head; w; w = w->next, i++) {
+		fds[i].fd = w->fd;
+		fds[i].events = ((w->flags & TM_FD_READABLE) ? POLLIN : 0) | ((w->flags & TM_FD_WRITABLE) ? POLLOUT : 0);
+		fds[i].revents = 0;
+	}
+#endif
 
   	void* sigh_alrm = signal(SIGALRM, wait_alarm);
   	void* sigh_int = signal(SIGINT, wait_int);
   	alarm(1);
 
-	int ret = poll(&fd, 1, ms);
+	int ret = poll(fds, nfds, ms);
 
 	alarm(0);
 	signal(SIGALRM, sigh_alrm);
   	signal(SIGINT, sigh_int);
 
-	if (ret > 0 && ((fd.revents & POLLIN) != 0))  {
+	if (ret > 0 && ((fds[0].revents & POLLIN) != 0))  {
 		uint8_t buffer[16*1024];
 		if (fgets((char*) buffer, sizeof(buffer), stdin) != NULL) {
 			colony_ipc_emit(tm_lua_state, "stdin", buffer, strlen((const char*) buffer));
 		}
 	}
 
+#ifdef __linux__
+	if (ret > 0 && nfds > 1 && fds[1].revents != 0) {
+		struct epoll_event events[64];
+		int n = epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]), 0);
+		for (int j = 0; j < n; j++) {
+			uint32_t e = events[j].events;
+			// Errors and hangups are reported as readable so the read observes them.
+			fd_watch_ready((tm_fd_watch*) events[j].data.ptr,
+				((e & (EPOLLIN | EPOLLERR | EPOLLHUP)) ? TM_FD_READABLE : 0) |
+				((e & EPOLLOUT) ? TM_FD_WRITABLE : 0));
+		}
+	}
+#else
+	if (ret > 0) {
+		// Walk the list again; callbacks haven't run yet so it is unchanged.
+		size_t j = 1;
+		for (tm_fd_watch* w = fd_watch_head; w; w = w->next, j++) {
+			short e = fds[j].revents;
+			fd_watch_ready(w,
+				((e & (POLLIN | POLLERR | POLLHUP)) ? TM_FD_READABLE : 0) |
+				((e & POLLOUT) ? TM_FD_WRITABLE : 0));
+		}
+	}
+#endif
+
 	if (tm_timer_waiting()) {
 		tm_event_trigger(&tm_timer_event);
 	}
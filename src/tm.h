@@ -66,6 +66,9 @@ bool tm_events_active();
 // Queue an event
 void tm_event_trigger(tm_event* event);
 
+// Remove an event from the queue if it is pending, so that it can be freed
+void tm_event_cancel(tm_event* event);
+
 // Process an event
 void tm_event_process();
 
@@ -111,10 +114,59 @@ unsigned tm_timer_base_time();
 // Clean up the timer queue
 void tm_timer_cleanup();
 
+// Immediates
+
+// The event triggered while immediates or ticks are queued
+extern tm_event tm_immediate_event;
+
+// Immediates run once per turn of the event loop; the returned id shares the
+// timer id space.
+unsigned tm_setimmediate(int lua_cb);
+void tm_clearimmediate(unsigned id);
+
+// Ticks run as soon as the current callback returns, before any other event.
+void tm_nexttick(int lua_cb);
+
+// Run all queued ticks. Called by the event loop after each event.
+void tm_tick_process();
+
+// Clean up the immediate and tick queues
+void tm_immediate_cleanup();
+
 // net
 
 typedef int tm_socket_t;
 
+// Readiness
+
+#define TM_FD_READABLE 0x1
+#define TM_FD_WRITABLE 0x2
+
+/// A descriptor registered with the event loop. `event` is triggered from
+/// hw_wait_for_event whenever `fd` is ready for any of `flags`, and `ready`
+/// holds the readiness that was observed at that time.
+typedef struct tm_fd_watch {
+  tm_event event;
+  tm_socket_t fd;
+  unsigned flags;
+  unsigned ready;
+  struct tm_fd_watch* next;
+} tm_fd_watch;
+
+// Implemented by the platform. Registering an already registered watch
+// replaces its interest flags.
+int tm_fd_register (tm_fd_watch* watch, tm_socket_t fd, unsigned flags);
+int tm_fd_unregister (tm_fd_watch* watch);
+
+// Watch a descriptor on behalf of a lua callback, which is called with the
+// ready flags. A descriptor has at most one watcher; starting it again
+// replaces the callback and flags.
+int tm_watch_start (tm_socket_t fd, unsigned flags, int lua_cb);
+void tm_watch_stop (tm_socket_t fd);
+
+// Clean up all watchers
+void tm_watch_cleanup ();
+
 // UDP
 
 tm_socket_t tm_udp_open ();
@@ -140,6 +192,11 @@ tm_socket_t tm_tcp_accept (tm_socket_t sock, uint32_t *addr, uint16_t *port);
 uint32_t tm_hostname_lookup (const uint8_t *hostname);
 uint32_t tm_net_dnsserver();
 
+// Resolve a hostname without blocking. The lua callback is called from the
+// event loop with an error code (or nil), an array of IPv4 addresses, and
+// the TTL of the answer in seconds (0 if it didn't come from DNS).
+int tm_dns_lookup (const char* domain, int lua_cb);
+
 // Random
 
 int tm_entropy_seed (void);
@@ -178,12 +235,16 @@ typedef void* tm_ssl_ctx_t;
 typedef void* tm_ssl_session_t;
 typedef struct dir_reg { const char *path; const unsigned char *src; unsigned int len; } dir_reg_t;
 
+// Contexts are shared between callers with the same options; each create
+// must be matched by a free.
 int tm_ssl_context_create (bool check_certs, dir_reg_t cert_bundle[], tm_ssl_ctx_t* ctx);
 int tm_ssl_context_free (tm_ssl_ctx_t *ctx);
 int tm_ssl_session_create (tm_ssl_session_t* session, tm_ssl_ctx_t ctx, tm_socket_t client_fd, const char* host_name);
 int tm_ssl_session_altname (tm_ssl_session_t* session, size_t index, const char** altname);
 int tm_ssl_session_cn (tm_ssl_session_t* session, const char** cn);
 int tm_ssl_session_free (tm_ssl_session_t *session);
+// Counts of resumed and full handshakes.
+void tm_ssl_session_stats (uint32_t* hits, uint32_t* misses);
 int tm_ssl_writeable (tm_ssl_session_t ssl);
 int tm_ssl_write (tm_ssl_session_t ssl, const uint8_t *buf, size_t *buf_len);
 int tm_ssl_read (tm_ssl_session_t ssl, uint8_t *buf, size_t *buf_len);
@@ -220,6 +281,12 @@ void tm_buffer_double_write (uint8_t* buf, size_t index, double value, tm_endian
 
 // ENCODINGS (UNICODE / ASCII / BINARY)
 
+// Length of the leading run of ASCII bytes, scanned a block at a time
+size_t tm_str_ascii_prefix (const uint8_t* buf, size_t len);
+int tm_str_is_ascii (const uint8_t* buf, size_t len);
+
+// The converters below return the input buffer itself through dstptr when
+// no transcoding is needed; callers free the result only if it differs.
 #define TM_UTF8_DECODE_ERROR UINT32_MAX
 size_t tm_utf8_decode(const uint8_t* buf, size_t buf_len, uint32_t* uc);
 size_t tm_utf8_encode(uint8_t* buf, size_t buf_len, uint32_t uc);
@@ -235,6 +302,14 @@ size_t tm_str_from_ascii (const uint8_t* buf, size_t buf_len, const uint8_t **ds
 size_t tm_str_to_binary (const uint8_t* buf, size_t buf_len, const uint8_t **dstptr);
 size_t tm_str_from_binary (const uint8_t* buf, size_t buf_len, const uint8_t **dstptr);
 
+// Encoded length includes padding. Decoding skips whitespace and other
+// characters outside the alphabet (accepting '-' and '_' from the URL-safe
+// variant) and stops at the first '='.
+size_t tm_base64_encode_length (size_t len);
+size_t tm_base64_encode (const uint8_t* in, size_t len, char* out);
+size_t tm_base64_decode_length (const char* in, size_t len);
+size_t tm_base64_decode (const char* in, size_t len, uint8_t* out);
+
 
 // INTERNAL STRING MANIPULATION
 
@@ -243,6 +318,27 @@ size_t tm_str_fromcode (uint32_t c, uint8_t* buf);
 size_t tm_str_lookup_JsToLua (const uint8_t* buf, size_t len, size_t index, size_t* seq_len);
 size_t tm_str_lookup_LuaToJs (const uint8_t* buf, size_t off);
 
+// Precomputed UCS-2 breakpoints for a string. ASCII strings carry no marks,
+// since byte offsets and UCS-2 indices coincide. The lookups below accept a
+// NULL index and then decode from the start of the string.
+typedef struct {
+  size_t byte;
+  size_t ucs2;
+} tm_str_mark_t;
+
+typedef struct {
+  int ascii;
+  size_t ucs2_len;
+  size_t count;
+  tm_str_mark_t marks[];
+} tm_str_index_t;
+
+size_t tm_str_index_size (const uint8_t* buf, size_t len);
+void tm_str_index_build (const uint8_t* buf, size_t len, tm_str_index_t* index);
+size_t tm_str_index_JsToLua (const uint8_t* buf, size_t len, const tm_str_index_t* index, size_t ucs2_index, size_t* seq_len);
+size_t tm_str_index_LuaToJs (const uint8_t* buf, size_t len, const tm_str_index_t* index, size_t off);
+uint32_t tm_str_index_codeat (const uint8_t* buf, size_t len, const tm_str_index_t* index, size_t ucs2_index);
+
 
 // ITOA
 
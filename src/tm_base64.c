@@ -0,0 +1,139 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+#include <tm.h>
+
+static const char base64_alphabet[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Decode table: 6-bit values for the alphabet (including the URL-safe '-' and
+// '_'), B64_PAD for '=', and B64_SKIP for anything that is ignored.
+#define B64_PAD 0x40
+#define B64_SKIP 0x80
+
+#define S B64_SKIP
+static const uint8_t base64_values[256] = {
+  S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,
+  S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,
+  S, S, S, S, S, S, S, S, S, S, S,62, S,62, S,63,
+ 52,53,54,55,56,57,58,59,60,61, S, S, S,B64_PAD, S, S,
+  S, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,
+ 15,16,17,18,19,20,21,22,23,24,25, S, S, S, S,63,
+  S,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,
+ 41,42,43,44,45,46,47,48,49,50,51, S, S, S, S, S,
+  S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,
+  S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,
+  S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,
+  S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,
+  S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,
+  S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,
+  S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,
+  S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,
+};
+#undef S
+
+size_t tm_base64_encode_length (size_t len)
+{
+  return ((len + 2) / 3) * 4;
+}
+
+size_t tm_base64_encode (const uint8_t* in, size_t len, char* out)
+{
+  char* p = out;
+  size_t i = 0;
+
+  // Whole blocks: 3 bytes in, 4 characters out, no branches.
+  for (; i + 3 <= len; i += 3) {
+    uint32_t v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+    p[0] = base64_alphabet[(v >> 18) & 0x3F];
+    p[1] = base64_alphabet[(v >> 12) & 0x3F];
+    p[2] = base64_alphabet[(v >> 6) & 0x3F];
+    p[3] = base64_alphabet[v & 0x3F];
+    p += 4;
+  }
+
+  // Tail, padded with '='.
+  if (i < len) {
+    uint32_t v = in[i] << 16;
+    if (i + 1 < len) {
+      v |= in[i + 1] << 8;
+    }
+    p[0] = base64_alphabet[(v >> 18) & 0x3F];
+    p[1] = base64_alphabet[(v >> 12) & 0x3F];
+    p[2] = i + 1 < len ? base64_alphabet[(v >> 6) & 0x3F] : '=';
+    p[3] = '=';
+    p += 4;
+  }
+
+  return p - out;
+}
+
+size_t tm_base64_decode_length (const char* in, size_t len)
+{
+  const uint8_t* s = (const uint8_t*) in;
+  size_t chars = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint8_t c = base64_values[s[i]];
+    if (c == B64_PAD) {
+      break;
+    }
+    chars += !(c & B64_SKIP);
+  }
+  return (chars * 6) / 8;
+}
+
+size_t tm_base64_decode (const char* in, size_t len, uint8_t* out)
+{
+  const uint8_t* s = (const uint8_t*) in;
+  uint8_t* p = out;
+  size_t i = 0;
+
+  uint32_t v = 0;
+  int bits = 0;
+  while (i < len) {
+    // Fast path: blocks of four alphabet characters.
+    while (i + 4 <= len) {
+      uint8_t a = base64_values[s[i]], b = base64_values[s[i + 1]],
+        c = base64_values[s[i + 2]], d = base64_values[s[i + 3]];
+      if ((a | b | c | d) & (B64_PAD | B64_SKIP)) {
+        break;
+      }
+      v = (a << 18) | (b << 12) | (c << 6) | d;
+      p[0] = v >> 16;
+      p[1] = v >> 8;
+      p[2] = v;
+      p += 3;
+      i += 4;
+    }
+
+    // Slow path: skip whitespace and invalid characters, stop at padding.
+    // Once a whole block has been decoded, go back to the fast path, so line
+    // breaks in wrapped input cost only the blocks they fall in.
+    for (; i < len; i++) {
+      uint8_t c = base64_values[s[i]];
+      if (c == B64_PAD) {
+        return p - out;
+      } else if (c & B64_SKIP) {
+        continue;
+      }
+      v = (v << 6) | c;
+      bits += 6;
+      if (bits >= 8) {
+        bits -= 8;
+        *p++ = v >> bits;
+        if (bits == 0) {
+          i++;
+          break;
+        }
+      }
+    }
+  }
+
+  return p - out;
+}
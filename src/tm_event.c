@@ -57,6 +57,31 @@ void tm_event_trigger(tm_event* event) {
 	tm_events_unlock();
 }
 
+void tm_event_cancel(tm_event* event) {
+	tm_events_lock();
+	if (event->pending) {
+		tm_event* prev = 0;
+		tm_event* e = event_queue_head;
+		while (e && e != event) {
+			prev = e;
+			e = e->next;
+		}
+		if (e) {
+			if (prev) {
+				prev->next = e->next;
+			} else {
+				event_queue_head = e->next;
+			}
+			if (event_queue_tail == e) {
+				event_queue_tail = prev;
+			}
+		}
+		event->pending = false;
+		event->next = 0;
+	}
+	tm_events_unlock();
+}
+
 bool tm_events_pending() {
 	return event_queue_head != 0;
 }
@@ -90,9 +115,11 @@ int tm_runtime_run(const char* script, const char** argv, int argc)
 		event_loop_retval = colony_runtime_run(script, argv, argc);
 
 		if (event_loop_retval == 0) {
+			tm_tick_process();
 			while (event_loop_keep_running && tm_events_active()) {
 				hw_wait_for_event();
 				tm_event_process();
+				tm_tick_process();
 			}
 		}
 	}
@@ -106,6 +133,8 @@ int tm_runtime_run(const char* script, const char** argv, int argc)
 	}
 
 	tm_timer_cleanup();
+	tm_watch_cleanup();
+	tm_immediate_cleanup();
 
 	event_loop_running = false;
 	return event_loop_retval;
@@ -0,0 +1,158 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+#include <lua.h>
+#include <lauxlib.h>
+#include "tm.h"
+#include "colony.h"
+
+void immediate_cb(tm_event* event);
+
+/// The event triggered while immediates (or ticks) are waiting to run
+tm_event tm_immediate_event = TM_EVENT_INIT(immediate_cb);
+
+// Immediates share the timer id space, so a stray clearTimeout is harmless.
+extern unsigned timer_id;
+
+typedef struct tm_immediate {
+  unsigned id;
+  int lua_cb; // Callback index in the lua registry, or LUA_NOREF once cleared
+} tm_immediate;
+
+/// A FIFO of callbacks stored in a growable ring buffer. Entries are appended
+/// in increasing id order, which lets clearImmediate binary search for them.
+typedef struct tm_queue {
+  tm_immediate* items;
+  size_t head;
+  size_t len;
+  size_t cap;
+} tm_queue;
+
+tm_queue immediates = { 0 };
+tm_queue ticks = { 0 };
+
+static tm_immediate* queue_at(tm_queue* q, size_t i) {
+	return &q->items[(q->head + i) & (q->cap - 1)];
+}
+
+static void queue_push(tm_queue* q, unsigned id, int lua_cb) {
+	if (q->len == q->cap) {
+		// Grow to the next power of two, unwrapping the ring as we go.
+		size_t cap = q->cap ? q->cap * 2 : 16;
+		tm_immediate* items = malloc(cap * sizeof(tm_immediate));
+		for (size_t i = 0; i < q->len; i++) {
+			items[i] = *queue_at(q, i);
+		}
+		free(q->items);
+		q->items = items;
+		q->head = 0;
+		q->cap = cap;
+	}
+	tm_immediate* e = queue_at(q, q->len++);
+	e->id = id;
+	e->lua_cb = lua_cb;
+}
+
+static tm_immediate queue_shift(tm_queue* q) {
+	tm_immediate e = *queue_at(q, 0);
+	q->head = (q->head + 1) & (q->cap - 1);
+	q->len--;
+	return e;
+}
+
+static void queue_clear(tm_queue* q) {
+	while (q->len) {
+		tm_immediate e = queue_shift(q);
+		luaL_unref(tm_lua_state, LUA_REGISTRYINDEX, e.lua_cb);
+	}
+	free(q->items);
+	q->items = NULL;
+	q->head = q->cap = 0;
+}
+
+/// Keep the event loop alive (and awake) while anything is queued.
+static void configure_immediate_event() {
+	if (immediates.len || ticks.len) {
+		tm_event_ref(&tm_immediate_event);
+		tm_event_trigger(&tm_immediate_event);
+	} else {
+		tm_event_unref(&tm_immediate_event);
+	}
+}
+
+static void call_immediate(tm_immediate e) {
+	// The callback is unreferenced before calling lua, as it can setjmp. It is
+	// safely rooted on the lua stack.
+	lua_rawgeti(tm_lua_state, LUA_REGISTRYINDEX, e.lua_cb);
+	luaL_unref(tm_lua_state, LUA_REGISTRYINDEX, e.lua_cb);
+	lua_getfield(tm_lua_state, LUA_GLOBALSINDEX, "global");
+	tm_checked_call(tm_lua_state, 1);
+}
+
+unsigned tm_setimmediate(int lua_cb) {
+	unsigned id = ++timer_id;
+	queue_push(&immediates, id, lua_cb);
+	configure_immediate_event();
+	return id;
+}
+
+void tm_clearimmediate(unsigned id) {
+	size_t lo = 0, hi = immediates.len;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		tm_immediate* e = queue_at(&immediates, mid);
+		if (e->id == id) {
+			// Leave a tombstone; it is skipped when the queue drains.
+			luaL_unref(tm_lua_state, LUA_REGISTRYINDEX, e->lua_cb);
+			e->lua_cb = LUA_NOREF;
+			return;
+		} else if ((int) (e->id - id) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+}
+
+void tm_nexttick(int lua_cb) {
+	queue_push(&ticks, 0, lua_cb);
+	configure_immediate_event();
+}
+
+void tm_tick_process() {
+	while (ticks.len) {
+		call_immediate(queue_shift(&ticks));
+	}
+}
+
+/// Runs pending ticks, then the immediates that were queued before this call.
+/// Immediates added by these callbacks wait for the next turn of the loop, so
+/// that I/O is not starved.
+void immediate_cb(tm_event* event) {
+	(void) event;
+
+	tm_tick_process();
+
+	size_t batch = immediates.len;
+	while (batch-- && immediates.len) {
+		tm_immediate e = queue_shift(&immediates);
+		if (e.lua_cb != LUA_NOREF) {
+			call_immediate(e);
+			tm_tick_process();
+		}
+	}
+
+	configure_immediate_event();
+}
+
+void tm_immediate_cleanup() {
+	queue_clear(&immediates);
+	queue_clear(&ticks);
+	tm_event_unref(&tm_immediate_event);
+}
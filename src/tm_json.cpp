@@ -13,6 +13,7 @@
 //
 
 #include "tm_json.h"
+#include <string.h>
 #include <rapidjson/reader.h>
 #include <rapidjson/writer.h>
 #include <rapidjson/rapidjson.h>
@@ -43,11 +44,37 @@ struct StateReaderHandler : public BaseReaderHandler<> {
     tm_json_r_handler_t rh_;
 };
 
+/* Read-only stream over a buffer of known length, which need not be
+   NUL-terminated. Reads past the end see '\0', as with StringStream. */
+struct LengthStream {
+    typedef char Ch;
+
+    LengthStream(const Ch* src, size_t len) : src_(src), begin_(src), end_(src + len) {}
+
+    Ch Peek() const { return src_ == end_ ? '\0' : *src_; }
+    Ch Take() { return src_ == end_ ? '\0' : *src_++; }
+    size_t Tell() const { return static_cast<size_t>(src_ - begin_); }
+
+    Ch* PutBegin() { RAPIDJSON_ASSERT(false); return 0; }
+    void Put(Ch) { RAPIDJSON_ASSERT(false); }
+    void Flush() { RAPIDJSON_ASSERT(false); }
+    size_t PutEnd(Ch*) { RAPIDJSON_ASSERT(false); return 0; }
+
+    const Ch* src_;
+    const Ch* begin_;
+    const Ch* end_;
+};
+
 /* Converts string to input stream and feeds it to rapidjson Parse function */
 extern "C" parse_error_t tm_json_parse(tm_json_r_handler_t rh,const char* json_s) {
+  return tm_json_parse_length(rh, json_s, strlen(json_s));
+}
+
+/* Parses len bytes of json_s in place, without copying the input */
+extern "C" parse_error_t tm_json_parse_length(tm_json_r_handler_t rh, const char* json_s, size_t len) {
 
-  // create an input stream from the stringified json input
-  StringStream is(json_s);
+  // create an input stream over the input
+  LengthStream is(json_s, len);
 
   // create a defaults flags GenericReader object
   Reader reader;
@@ -66,79 +93,134 @@ extern "C" parse_error_t tm_json_parse(tm_json_r_handler_t rh,const char* json_s
 
 }
 
-/* Creates a new Writer object and returns it to C as a void pointer */
+typedef CompactWriter<StringBuffer> CompactStringWriter;
+typedef PrettyWriter<StringBuffer> PrettyStringWriter;
+
+/* Calls a method on whichever writer the handler holds */
+#define TM_JSON_WRITE(wh, call) \
+  do { \
+    if (wh.compact) { \
+      static_cast<CompactStringWriter*>(wh.writer)->call; \
+    } else { \
+      static_cast<PrettyStringWriter*>(wh.writer)->call; \
+    } \
+  } while (0)
+
+/* Creates a new Writer object and returns it to C as a void pointer. Without
+   indentation, the compact writer is used. */
 extern "C" tm_json_w_handler_t tm_json_write_create(const char* indentation, size_t indentCharCount) {
 
   // create the writer handler
   tm_json_w_handler_t wh;
-  
-  // allocate the writer and assugn in in the struct
+
+  // allocate the string buffer and assign it in the struct
   StringBuffer* sb = new StringBuffer();
   wh.stringBuffer = static_cast<tm_json_stringbuffer_t>(sb);
 
-  // allocate the string buffer and assign it in the struct
-  PrettyWriter<StringBuffer>* w = new PrettyWriter<StringBuffer>(*sb);
-  wh.writer = static_cast<tm_json_writer_t>(w);
-  w->SetIndent(indentation, indentCharCount);
+  // allocate the writer and assign it in the struct
+  wh.compact = indentCharCount == 0;
+  if (wh.compact) {
+    CompactStringWriter* w = new CompactStringWriter(*sb);
+    w->SetDoublePrecision(12);
+    wh.writer = static_cast<tm_json_writer_t>(w);
+  } else {
+    PrettyStringWriter* w = new PrettyStringWriter(*sb);
+    w->SetDoublePrecision(12);
+    w->SetIndent(indentation, indentCharCount);
+    wh.writer = static_cast<tm_json_writer_t>(w);
+  }
 
   // return the actual write handler containing void pointers
   return wh;
 }
 
+/* Writers shared between calls. They write into one buffer, which keeps its
+   capacity, so a call that doesn't overlap another allocates nothing. */
+static StringBuffer* shared_sb = NULL;
+static CompactStringWriter* shared_compact = NULL;
+static PrettyStringWriter* shared_pretty = NULL;
+static bool shared_busy = false;
+
+/* Fills in the shared writer, reset, unless it is already in use */
+extern "C" int tm_json_write_shared(tm_json_w_handler_t* wh, const char* indentation, size_t indentCharCount) {
+  if (shared_busy) {
+    return -1;
+  }
+  if (shared_sb == NULL) {
+    shared_sb = new StringBuffer();
+    shared_compact = new CompactStringWriter(*shared_sb);
+    shared_compact->SetDoublePrecision(12);
+    shared_pretty = new PrettyStringWriter(*shared_sb);
+    shared_pretty->SetDoublePrecision(12);
+  }
+  shared_busy = true;
+
+  // a previous call may have stopped partway through
+  shared_sb->Clear();
+  wh->stringBuffer = static_cast<tm_json_stringbuffer_t>(shared_sb);
+  wh->compact = indentCharCount == 0;
+  if (wh->compact) {
+    shared_compact->Reset();
+    wh->writer = static_cast<tm_json_writer_t>(shared_compact);
+  } else {
+    shared_pretty->Reset();
+    shared_pretty->SetIndent(indentation, indentCharCount);
+    wh->writer = static_cast<tm_json_writer_t>(shared_pretty);
+  }
+  return 0;
+}
+
+/* Returns the shared writer for the next call */
+extern "C" void tm_json_write_release(tm_json_w_handler_t wh) {
+  (void) wh;
+  shared_busy = false;
+}
+
 /* Writes out a String using rapidjson functions */
 extern "C" int tm_json_write_string(tm_json_w_handler_t wh, const char* value, size_t len) {
-  PrettyWriter<StringBuffer>* w = static_cast<PrettyWriter<StringBuffer>*>(wh.writer);
-  w->String(value, len);
+  TM_JSON_WRITE(wh, String(value, len));
   return 0;
 }
 
 /* Writes out a Bool using rapidjson functions */
 extern "C" int tm_json_write_boolean (tm_json_w_handler_t wh, int value) {
-  PrettyWriter<StringBuffer>* w = static_cast<PrettyWriter<StringBuffer>*>(wh.writer);
-  w->Bool(value);
+  TM_JSON_WRITE(wh, Bool(value));
   return 0;
 }
 
 /* Writes out a Number using rapidjson functions */
 extern "C" int tm_json_write_number (tm_json_w_handler_t wh, double value) {
-  PrettyWriter<StringBuffer>* w = static_cast<PrettyWriter<StringBuffer>*>(wh.writer);
-  w->SetDoublePrecision(12);
-  w->Double(value);
+  TM_JSON_WRITE(wh, Double(value));
   return 0;
 }
 
 /* Writes out Null using rapidjson functions */
 extern "C" int tm_json_write_null (tm_json_w_handler_t wh) {
-  PrettyWriter<StringBuffer>* w = static_cast<PrettyWriter<StringBuffer>*>(wh.writer);
-  w->Null();
+  TM_JSON_WRITE(wh, Null());
   return 0;
 }
 
 /* Writes out an object start using rapidjson functions */
 extern "C" int tm_json_write_object_start (tm_json_w_handler_t wh) {
-  PrettyWriter<StringBuffer>* w = static_cast<PrettyWriter<StringBuffer>*>(wh.writer);
-  w->StartObject();
+  TM_JSON_WRITE(wh, StartObject());
   return 0;
 }
 
 /* Writes out an object end using rapidjson functions */
 extern "C" int tm_json_write_object_end (tm_json_w_handler_t wh) {
-  PrettyWriter<StringBuffer>* w = static_cast<PrettyWriter<StringBuffer>*>(wh.writer);
-  w->EndObject();
+  TM_JSON_WRITE(wh, EndObject());
   return 0;
 }
 
 /* Writes out an array start using rapidjson functions */
 extern "C" int tm_json_write_array_start (tm_json_w_handler_t wh) {
-  PrettyWriter<StringBuffer>* w = static_cast<PrettyWriter<StringBuffer>*>(wh.writer);
-  w->StartArray();
+  TM_JSON_WRITE(wh, StartArray());
   return 0;
 }
 
 /* Writes out an array end using rapidjson functions */
 extern "C" int tm_json_write_array_end (tm_json_w_handler_t wh) {
-  PrettyWriter<StringBuffer>* w = static_cast<PrettyWriter<StringBuffer>*>(wh.writer);
-  w->EndArray();
+  TM_JSON_WRITE(wh, EndArray());
   return 0;
 }
 
@@ -148,9 +230,19 @@ extern "C" const char* tm_json_write_result (tm_json_w_handler_t wh) {
   return sb->GetString();
 }
 
+/* Returns the length of the written JSON text */
+extern "C" size_t tm_json_write_length (tm_json_w_handler_t wh) {
+  StringBuffer* sb = static_cast<StringBuffer*>(wh.stringBuffer);
+  return sb->GetSize();
+}
+
 /* Frees the writer, string buffer, and the struct holding them all */
 extern "C" int tm_json_write_destroy(tm_json_w_handler_t wh) {
-  delete static_cast<PrettyWriter<StringBuffer>*>(wh.writer);
+  if (wh.compact) {
+    delete static_cast<CompactStringWriter*>(wh.writer);
+  } else {
+    delete static_cast<PrettyStringWriter*>(wh.writer);
+  }
   delete static_cast<StringBuffer*>(wh.stringBuffer);
   return 0;
 }
@@ -7,6 +7,9 @@
 // option. This file may not be copied, modified, or distributed
 // except according to those terms.
 
+#ifndef _TM_JSON_H_
+#define _TM_JSON_H_
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -40,10 +43,12 @@ typedef struct tm_json_r_handler {
 typedef void* tm_json_writer_t;
 typedef void* tm_json_stringbuffer_t;
 
-/* Contains pointers to Writer and String Buffer */
+/* Contains pointers to Writer and String Buffer. The writer is a compact
+   one when there is no indentation. */
 typedef struct tm_json_w_handler {
   tm_json_writer_t writer;
   tm_json_stringbuffer_t stringBuffer;
+  int compact;
 } tm_json_w_handler_t;
 
 /* Holds the parse error code and offset of the error */
@@ -54,9 +59,12 @@ typedef struct parse_error {
 
 /* Reading prototypes */
 parse_error_t tm_json_parse(tm_json_r_handler_t,const char*);
+parse_error_t tm_json_parse_length(tm_json_r_handler_t, const char*, size_t);
 
 /* Writing prototypes */
 tm_json_w_handler_t tm_json_write_create(const char* indentation, size_t indent_count);
+int tm_json_write_shared(tm_json_w_handler_t* wh, const char* indentation, size_t indent_count);
+void tm_json_write_release(tm_json_w_handler_t wh);
 int tm_json_write_string (tm_json_w_handler_t wh, const char* value, size_t len);
 int tm_json_write_boolean (tm_json_w_handler_t, int);
 int tm_json_write_number (tm_json_w_handler_t, double);
@@ -66,9 +74,58 @@ int tm_json_write_object_end (tm_json_w_handler_t);
 int tm_json_write_array_start (tm_json_w_handler_t);
 int tm_json_write_array_end (tm_json_w_handler_t);
 const char* tm_json_write_result (tm_json_w_handler_t);
+size_t tm_json_write_length (tm_json_w_handler_t);
 int tm_json_write_destroy(tm_json_w_handler_t);
 
+/* Incremental framing of a JSON stream. Values at the selected path (keys
+   separated by '.', with '*' matching any key or array index) are passed
+   to the callback as complete JSON text as soon as they end. */
+#define TM_JSON_STREAM_DEPTH 64
+#define TM_JSON_STREAM_SEGMENTS 8
+
+#define TM_JSON_STREAM_ESYNTAX 1
+#define TM_JSON_STREAM_EDEPTH 2
+#define TM_JSON_STREAM_EEND 3
+#define TM_JSON_STREAM_ENOMEM 4
+
+typedef int (*tm_json_stream_cb)(void* state, const char* value, size_t len);
+
+typedef struct tm_json_stream_frame {
+  char type;
+  uint8_t want_key;
+  uint8_t matched;
+  size_t index;
+} tm_json_stream_frame_t;
+
+typedef struct tm_json_stream {
+  char path[128];
+  size_t seg_start[TM_JSON_STREAM_SEGMENTS];
+  size_t seg_len[TM_JSON_STREAM_SEGMENTS];
+  size_t seg_count;
+  tm_json_stream_frame_t frames[TM_JSON_STREAM_DEPTH];
+  size_t depth;
+  int state;
+  int in_key;
+  char key[64];
+  size_t key_len;
+  int capturing;
+  size_t capture_depth;
+  size_t value_offset;
+  size_t offset;
+  char* buf;
+  size_t buf_len;
+  size_t buf_cap;
+  int error;
+} tm_json_stream_t;
+
+int tm_json_stream_init (tm_json_stream_t* s, const char* path, size_t path_len);
+int tm_json_stream_write (tm_json_stream_t* s, const char* data, size_t len, tm_json_stream_cb cb, void* state);
+int tm_json_stream_end (tm_json_stream_t* s, tm_json_stream_cb cb, void* state);
+void tm_json_stream_free (tm_json_stream_t* s);
+
 /* Guard to make sure that this is used as C */
 #ifdef __cplusplus
 }
 #endif
+
+#endif
@@ -0,0 +1,306 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+//
+// Incremental JSON framing. Chunks are scanned for structure only (nesting,
+// strings, object keys) so that the scanner can stop at any byte and resume
+// with the next chunk. Each value at the selected path is handed to the
+// callback once it is complete, to be parsed by the regular reader; bytes
+// outside selected values are never buffered.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "tm_json.h"
+
+enum {
+  STREAM_VALUE = 0,
+  STREAM_STRING,
+  STREAM_ESCAPE,
+  STREAM_SCALAR,
+};
+
+int tm_json_stream_init (tm_json_stream_t* s, const char* path, size_t path_len)
+{
+  memset(s, 0, sizeof(*s));
+  if (path_len > sizeof(s->path)) {
+    return -1;
+  }
+
+  // Split the path on '.'; an empty path selects each top-level value.
+  memcpy(s->path, path, path_len);
+  size_t start = 0;
+  for (size_t i = 0; path_len > 0 && i <= path_len; i++) {
+    if (i == path_len || path[i] == '.') {
+      if (s->seg_count == TM_JSON_STREAM_SEGMENTS) {
+        return -1;
+      }
+      s->seg_start[s->seg_count] = start;
+      s->seg_len[s->seg_count] = i - start;
+      s->seg_count++;
+      start = i + 1;
+    }
+  }
+  return 0;
+}
+
+void tm_json_stream_free (tm_json_stream_t* s)
+{
+  free(s->buf);
+  s->buf = NULL;
+  s->buf_len = s->buf_cap = 0;
+}
+
+static int stream_append (tm_json_stream_t* s, const char* data, size_t len)
+{
+  if (s->buf_len + len > s->buf_cap) {
+    size_t cap = s->buf_cap ? s->buf_cap : 256;
+    while (cap < s->buf_len + len) {
+      cap *= 2;
+    }
+    char* buf = realloc(s->buf, cap);
+    if (buf == NULL) {
+      return -1;
+    }
+    s->buf = buf;
+    s->buf_cap = cap;
+  }
+  memcpy(s->buf + s->buf_len, data, len);
+  s->buf_len += len;
+  return 0;
+}
+
+// Emits the captured value ending at data[end]. A value that lies within
+// one chunk is passed straight from the chunk.
+static int stream_emit (tm_json_stream_t* s, const char* data, size_t start, size_t end, tm_json_stream_cb cb, void* state)
+{
+  s->capturing = 0;
+  if (s->buf_len == 0) {
+    return cb(state, data + start, end - start);
+  }
+  if (stream_append(s, data + start, end - start) != 0) {
+    return TM_JSON_STREAM_ENOMEM;
+  }
+  size_t total = s->buf_len;
+  s->buf_len = 0;
+  return cb(state, s->buf, total);
+}
+
+static int stream_segment_match (tm_json_stream_t* s, size_t seg, const char* key, size_t key_len)
+{
+  const char* p = &s->path[s->seg_start[seg]];
+  size_t len = s->seg_len[seg];
+  return (len == 1 && p[0] == '*') || (len == key_len && memcmp(p, key, len) == 0);
+}
+
+// A value is starting at the current depth. Returns true if it is selected
+// and capture has begun.
+static int stream_value_start (tm_json_stream_t* s)
+{
+  if (s->capturing || s->depth > s->seg_count) {
+    return 0;
+  }
+
+  if (s->depth > 0) {
+    tm_json_stream_frame_t* frame = &s->frames[s->depth - 1];
+    if (frame->type == '[') {
+      char index[24];
+      size_t len = 0;
+      size_t n = frame->index;
+      do {
+        index[sizeof(index) - ++len] = '0' + (n % 10);
+        n /= 10;
+      } while (n > 0);
+      frame->matched = stream_segment_match(s, s->depth - 1, &index[sizeof(index) - len], len);
+    }
+  }
+  if (s->depth != s->seg_count) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < s->depth; i++) {
+    if (!s->frames[i].matched) {
+      return 0;
+    }
+  }
+  s->capturing = 1;
+  s->capture_depth = s->depth;
+  s->value_offset = s->offset;
+  return 1;
+}
+
+int tm_json_stream_write (tm_json_stream_t* s, const char* data, size_t len, tm_json_stream_cb cb, void* state)
+{
+  if (s->error) {
+    return s->error;
+  }
+
+  // A value continued from an earlier chunk is captured from the start.
+  size_t start = 0;
+  int r = 0;
+
+  for (size_t i = 0; i < len; i++, s->offset++) {
+    char c = data[i];
+
+    switch (s->state) {
+      case STREAM_STRING:
+        if (c == '\\') {
+          s->state = STREAM_ESCAPE;
+        } else if (c == '"') {
+          s->state = STREAM_VALUE;
+          if (s->in_key) {
+            tm_json_stream_frame_t* frame = &s->frames[s->depth - 1];
+            s->in_key = 0;
+            frame->matched = s->depth <= s->seg_count && s->key_len <= sizeof(s->key)
+              && stream_segment_match(s, s->depth - 1, s->key, s->key_len);
+            continue;
+          }
+          if (s->capturing && s->depth == s->capture_depth) {
+            r = stream_emit(s, data, start, i + 1, cb, state);
+          }
+          break;
+        }
+        if (s->in_key) {
+          if (s->key_len < sizeof(s->key)) {
+            s->key[s->key_len] = c;
+          }
+          s->key_len++;
+        }
+        continue;
+
+      case STREAM_ESCAPE:
+        if (s->in_key) {
+          if (s->key_len < sizeof(s->key)) {
+            s->key[s->key_len] = c;
+          }
+          s->key_len++;
+        }
+        s->state = STREAM_STRING;
+        continue;
+
+      case STREAM_SCALAR:
+        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+          || c == '-' || c == '+' || c == '.') {
+          continue;
+        }
+        s->state = STREAM_VALUE;
+        if (s->capturing && s->depth == s->capture_depth) {
+          r = stream_emit(s, data, start, i, cb, state);
+          if (r != 0) {
+            break;
+          }
+        }
+        // The delimiter is handled as structure.
+        // fall through
+
+      case STREAM_VALUE:
+        switch (c) {
+          case ' ': case '\t': case '\r': case '\n':
+            break;
+
+          case '{':
+          case '[':
+            if (s->depth == TM_JSON_STREAM_DEPTH) {
+              r = TM_JSON_STREAM_EDEPTH;
+              break;
+            }
+            if (stream_value_start(s)) {
+              start = i;
+            }
+            s->frames[s->depth].type = c;
+            s->frames[s->depth].want_key = c == '{';
+            s->frames[s->depth].matched = 0;
+            s->frames[s->depth].index = 0;
+            s->depth++;
+            break;
+
+          case '}':
+          case ']':
+            if (s->depth == 0 || s->frames[s->depth - 1].type != (c == '}' ? '{' : '[')) {
+              r = TM_JSON_STREAM_ESYNTAX;
+              break;
+            }
+            s->depth--;
+            if (s->capturing && s->depth == s->capture_depth) {
+              r = stream_emit(s, data, start, i + 1, cb, state);
+            }
+            break;
+
+          case ',':
+            if (s->depth == 0) {
+              r = TM_JSON_STREAM_ESYNTAX;
+            } else if (s->frames[s->depth - 1].type == '{') {
+              s->frames[s->depth - 1].want_key = 1;
+            } else {
+              s->frames[s->depth - 1].index++;
+            }
+            break;
+
+          case ':':
+            if (s->depth == 0 || s->frames[s->depth - 1].type != '{') {
+              r = TM_JSON_STREAM_ESYNTAX;
+            }
+            break;
+
+          case '"':
+            s->state = STREAM_STRING;
+            if (s->depth > 0 && s->frames[s->depth - 1].want_key) {
+              s->frames[s->depth - 1].want_key = 0;
+              s->in_key = 1;
+              s->key_len = 0;
+              break;
+            }
+            if (stream_value_start(s)) {
+              start = i;
+            }
+            break;
+
+          default:
+            s->state = STREAM_SCALAR;
+            if (stream_value_start(s)) {
+              start = i;
+            }
+            break;
+        }
+        break;
+    }
+
+    if (r != 0) {
+      break;
+    }
+  }
+
+  // Keep the unfinished part of a selected value for the next chunk.
+  if (r == 0 && s->capturing && stream_append(s, data + start, len - start) != 0) {
+    r = TM_JSON_STREAM_ENOMEM;
+  }
+
+  s->error = r;
+  return r;
+}
+
+int tm_json_stream_end (tm_json_stream_t* s, tm_json_stream_cb cb, void* state)
+{
+  if (s->error) {
+    return s->error;
+  }
+
+  // Only a top-level number or literal can end without a delimiter.
+  if (s->state == STREAM_SCALAR && s->depth == 0) {
+    s->state = STREAM_VALUE;
+    if (s->capturing) {
+      s->error = stream_emit(s, "", 0, 0, cb, state);
+      return s->error;
+    }
+  }
+  if (s->state != STREAM_VALUE || s->depth > 0) {
+    s->error = TM_JSON_STREAM_EEND;
+  }
+  return s->error;
+}
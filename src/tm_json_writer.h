@@ -45,6 +45,9 @@ public:
         return *this;
     }
 
+    //! Discard any unfinished JSON text, so the writer can be reused.
+    void Reset() { Base::level_stack_.Clear(); }
+
     /*! @name Implementation of Handler
         \see Handler
     */
@@ -187,6 +190,108 @@ private:
     PrettyWriter& operator=(const PrettyWriter&);
 };
 
+//! Writer without whitespace.
+/*! Like PrettyWriter, and unlike Writer, this accepts any value at the root
+    and writes NaN and infinities as null.
+*/
+template<typename OutputStream, typename SourceEncoding = UTF8<>, typename TargetEncoding = UTF8<>, typename Allocator = MemoryPoolAllocator<> >
+class CompactWriter : public Writer<OutputStream, SourceEncoding, TargetEncoding, Allocator> {
+public:
+    typedef Writer<OutputStream, SourceEncoding, TargetEncoding, Allocator> Base;
+    typedef typename Base::Ch Ch;
+
+    //! Constructor
+    CompactWriter(OutputStream& os, Allocator* allocator = 0, size_t levelDepth = Base::kDefaultLevelDepth) :
+        Base(os, allocator, levelDepth) {}
+
+    //! Overridden for fluent API, see \ref Writer::SetDoublePrecision()
+    CompactWriter& SetDoublePrecision(int p) { Base::SetDoublePrecision(p); return *this; }
+
+    //! Discard any unfinished JSON text, so the writer can be reused.
+    void Reset() { Base::level_stack_.Clear(); }
+
+    /*! @name Implementation of Handler
+        \see Handler
+    */
+    //@{
+
+    CompactWriter& Null()                { CompactPrefix(); Base::WriteNull();         return *this; }
+    CompactWriter& Bool(bool b)          { CompactPrefix(); Base::WriteBool(b);        return *this; }
+    CompactWriter& Int(int i)            { CompactPrefix(); Base::WriteInt(i);         return *this; }
+    CompactWriter& Uint(unsigned u)      { CompactPrefix(); Base::WriteUint(u);        return *this; }
+    CompactWriter& Int64(int64_t i64)    { CompactPrefix(); Base::WriteInt64(i64);     return *this; }
+    CompactWriter& Uint64(uint64_t u64)  { CompactPrefix(); Base::WriteUint64(u64);    return *this; }
+    CompactWriter& Double(double d)      {
+        // NaN, Infinity or -Infinity
+        if ((d != d) || (d/d != d/d && d != 0)) { return Null(); }
+        else { CompactPrefix(); Base::WriteDouble(d); return *this; }
+    }
+
+    CompactWriter& String(const Ch* str, SizeType length, bool copy = false) {
+        (void)copy;
+        CompactPrefix();
+        Base::WriteString(str, length);
+        return *this;
+    }
+
+    CompactWriter& StartObject() {
+        CompactPrefix();
+        new (Base::level_stack_.template Push<typename Base::Level>()) typename Base::Level(false);
+        Base::WriteStartObject();
+        return *this;
+    }
+
+    CompactWriter& EndObject(SizeType memberCount = 0) {
+        (void)memberCount;
+        RAPIDJSON_ASSERT(Base::level_stack_.GetSize() >= sizeof(typename Base::Level));
+        RAPIDJSON_ASSERT(!Base::level_stack_.template Top<typename Base::Level>()->inArray);
+        Base::level_stack_.template Pop<typename Base::Level>(1);
+        Base::WriteEndObject();
+        if (Base::level_stack_.Empty()) // end of json text
+            Base::os_.Flush();
+        return *this;
+    }
+
+    CompactWriter& StartArray() {
+        CompactPrefix();
+        new (Base::level_stack_.template Push<typename Base::Level>()) typename Base::Level(true);
+        Base::WriteStartArray();
+        return *this;
+    }
+
+    CompactWriter& EndArray(SizeType memberCount = 0) {
+        (void)memberCount;
+        RAPIDJSON_ASSERT(Base::level_stack_.GetSize() >= sizeof(typename Base::Level));
+        RAPIDJSON_ASSERT(Base::level_stack_.template Top<typename Base::Level>()->inArray);
+        Base::level_stack_.template Pop<typename Base::Level>(1);
+        Base::WriteEndArray();
+        if (Base::level_stack_.Empty()) // end of json text
+            Base::os_.Flush();
+        return *this;
+    }
+
+    //@}
+
+protected:
+    void CompactPrefix() {
+        if (Base::level_stack_.GetSize() != 0) { // this value is not at root
+            typename Base::Level* level = Base::level_stack_.template Top<typename Base::Level>();
+            if (level->valueCount > 0) {
+                if (level->inArray)
+                    Base::os_.Put(','); // add comma if it is not the first element in array
+                else  // in object
+                    Base::os_.Put((level->valueCount % 2 == 0) ? ',' : ':');
+            }
+            level->valueCount++;
+        }
+    }
+
+private:
+    // Prohibit copy constructor & assignment operator.
+    CompactWriter(const CompactWriter&);
+    CompactWriter& operator=(const CompactWriter&);
+};
+
 } // namespace rapidjson
 
 #ifdef __GNUC__
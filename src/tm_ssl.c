@@ -12,6 +12,7 @@
 #include <os_port.h>
 #include <ssl.h>
 #include <assert.h>
+#include <time.h>
 
 #ifdef TLS_VERBOSE
 #define TLS_DEBUG(...) printf(__VA_ARGS__)
@@ -63,7 +64,30 @@ int tm_ssl_read (tm_ssl_session_t ssl, uint8_t *buf, size_t *buf_len)
 
 extern dir_reg_t cacert_bundle[];
 
-int tm_ssl_context_create (bool check_certs, dir_reg_t cert_bundle[], tm_ssl_ctx_t* ctx)
+/**
+ * Session cache. The session ID from the last full handshake with each host
+ * is kept with the context (which holds the session secrets) and offered on
+ * the next connection to that host, skipping the key exchange. The server
+ * certificate isn't sent again on a resumed session, so its names are kept
+ * along with the ID.
+ */
+
+#define TM_SSL_SESSIONS 8
+#define TM_SSL_SESSION_EXPIRY (60*60)
+
+typedef struct ssl_host_session {
+    uint8_t id[SSL_SESSION_ID_SIZE];
+    uint8_t id_len;
+    time_t created;
+    uint32_t used;
+    char* names;        // host, then certificate CN and altnames, each \0-terminated
+    size_t names_count;
+} ssl_host_session_t;
+
+static uint32_t ssl_session_hits = 0;
+static uint32_t ssl_session_misses = 0;
+
+static int ssl_context_new (bool check_certs, dir_reg_t cert_bundle[], SSL_CTX** ctx)
 {
 #ifdef TLS_VERBOSE
     uint32_t options = SSL_DISPLAY_CERTS;
@@ -79,7 +103,7 @@ int tm_ssl_context_create (bool check_certs, dir_reg_t cert_bundle[], tm_ssl_ctx
     }
 
     SSL_CTX *ssl_ctx;
-    if ((ssl_ctx = ssl_ctx_new(options, SSL_DEFAULT_CLNT_SESS)) == NULL)
+    if ((ssl_ctx = ssl_ctx_new(options, TM_SSL_SESSIONS)) == NULL)
     {
         TLS_DEBUG("SSL client context is invalid.\n");
         return -1;
@@ -89,6 +113,7 @@ int tm_ssl_context_create (bool check_certs, dir_reg_t cert_bundle[], tm_ssl_ctx
 //printf("Adding cert #%zu: %s <%u>\n", i, cert_bundle[i].src, cert_bundle[i].len);
         if (add_cert_auth(ssl_ctx, cert_bundle[i].src, 1)) {
             TLS_DEBUG("Invalid CA cert bundle at index %zu, aborting.\n", i);
+            ssl_ctx_free(ssl_ctx);
             return -1;
         }
     }
@@ -104,13 +129,274 @@ int tm_ssl_context_create (bool check_certs, dir_reg_t cert_bundle[], tm_ssl_ctx
     return 0;
 }
 
+/**
+ * Client contexts are shared by every connection with the same options, so
+ * the CA bundle is parsed once rather than per socket. A context is
+ * refcounted while in use, and up to TM_SSL_CTX_IDLE unused contexts are
+ * kept for later connections.
+ */
+
+#define TM_SSL_CTX_IDLE 2
+
+typedef struct ssl_ctx_entry {
+    struct ssl_ctx_entry* next;
+    SSL_CTX* ctx;
+    bool check_certs;
+    bool custom;
+    size_t refs;
+    uint32_t used;
+    ssl_host_session_t sessions[TM_SSL_SESSIONS];
+    size_t certs_len;
+    uint8_t certs[];    // custom certs, each as its length then its bytes
+} ssl_ctx_entry_t;
+
+static ssl_ctx_entry_t* ssl_ctx_cache = NULL;
+static uint32_t ssl_ctx_clock = 0;
+
+// Copies the custom certs into certs (if given) and returns their size.
+static size_t ssl_ctx_certs (dir_reg_t cert_bundle[], uint8_t* certs)
+{
+    size_t len = 0;
+    for (size_t i = 0; cert_bundle != NULL && cert_bundle[i].path != NULL; i++) {
+        if (certs != NULL) {
+            memcpy(&certs[len], &cert_bundle[i].len, sizeof(cert_bundle[i].len));
+            memcpy(&certs[len + sizeof(cert_bundle[i].len)], cert_bundle[i].src, cert_bundle[i].len);
+        }
+        len += sizeof(cert_bundle[i].len) + cert_bundle[i].len;
+    }
+    return len;
+}
+
+static bool ssl_ctx_matches (ssl_ctx_entry_t* entry, bool check_certs, dir_reg_t cert_bundle[])
+{
+    if (entry->check_certs != check_certs || entry->custom != (cert_bundle != NULL)) {
+        return false;
+    }
+    size_t len = 0;
+    for (size_t i = 0; cert_bundle != NULL && cert_bundle[i].path != NULL; i++) {
+        unsigned int cert_len;
+        if (len + sizeof(cert_len) > entry->certs_len) {
+            return false;
+        }
+        memcpy(&cert_len, &entry->certs[len], sizeof(cert_len));
+        len += sizeof(cert_len);
+        if (cert_len != cert_bundle[i].len || len + cert_len > entry->certs_len
+          || memcmp(&entry->certs[len], cert_bundle[i].src, cert_len) != 0) {
+            return false;
+        }
+        len += cert_len;
+    }
+    return len == entry->certs_len;
+}
+
+// Frees the least recently used idle contexts beyond TM_SSL_CTX_IDLE.
+static void ssl_ctx_trim ()
+{
+    while (1) {
+        size_t idle = 0;
+        ssl_ctx_entry_t** oldest = NULL;
+        for (ssl_ctx_entry_t** e = &ssl_ctx_cache; *e != NULL; e = &(*e)->next) {
+            if ((*e)->refs == 0) {
+                idle++;
+                if (oldest == NULL || (int32_t) ((*e)->used - (*oldest)->used) < 0) {
+                    oldest = e;
+                }
+            }
+        }
+        if (idle <= TM_SSL_CTX_IDLE) {
+            return;
+        }
+        ssl_ctx_entry_t* entry = *oldest;
+        *oldest = entry->next;
+        for (size_t i = 0; i < TM_SSL_SESSIONS; i++) {
+            free(entry->sessions[i].names);
+        }
+        ssl_ctx_free(entry->ctx);
+        free(entry);
+    }
+}
+
+int tm_ssl_context_create (bool check_certs, dir_reg_t cert_bundle[], tm_ssl_ctx_t* ctx)
+{
+    for (ssl_ctx_entry_t* e = ssl_ctx_cache; e != NULL; e = e->next) {
+        if (ssl_ctx_matches(e, check_certs, cert_bundle)) {
+            e->refs++;
+            e->used = ++ssl_ctx_clock;
+            *ctx = e->ctx;
+            return 0;
+        }
+    }
+
+    SSL_CTX* ssl_ctx;
+    if (ssl_context_new(check_certs, cert_bundle, &ssl_ctx) != 0) {
+        return -1;
+    }
+
+    size_t certs_len = ssl_ctx_certs(cert_bundle, NULL);
+    ssl_ctx_entry_t* entry = malloc(sizeof(ssl_ctx_entry_t) + certs_len);
+    if (entry == NULL) {
+        ssl_ctx_free(ssl_ctx);
+        return -1;
+    }
+    memset(entry, 0, sizeof(ssl_ctx_entry_t));
+    entry->ctx = ssl_ctx;
+    entry->check_certs = check_certs;
+    entry->custom = cert_bundle != NULL;
+    entry->refs = 1;
+    entry->used = ++ssl_ctx_clock;
+    entry->certs_len = ssl_ctx_certs(cert_bundle, entry->certs);
+    entry->next = ssl_ctx_cache;
+    ssl_ctx_cache = entry;
+
+    *ctx = ssl_ctx;
+    return 0;
+}
+
 
 int tm_ssl_context_free (tm_ssl_ctx_t *ctx)
 {
+    for (ssl_ctx_entry_t* e = ssl_ctx_cache; e != NULL; e = e->next) {
+        if (e->ctx == *ctx) {
+            if (e->refs > 0) {
+                e->refs--;
+            }
+            e->used = ++ssl_ctx_clock;
+            ssl_ctx_trim();
+            return 0;
+        }
+    }
     ssl_ctx_free(*ctx);
     return 0;
 }
 
+static ssl_ctx_entry_t* ssl_ctx_entry (SSL_CTX* ctx)
+{
+    for (ssl_ctx_entry_t* e = ssl_ctx_cache; e != NULL; e = e->next) {
+        if (e->ctx == ctx) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void ssl_session_drop (ssl_host_session_t* session)
+{
+    free(session->names);
+    memset(session, 0, sizeof(*session));
+}
+
+// Returns the session to offer to host, if it is still usable.
+static ssl_host_session_t* ssl_session_find (ssl_ctx_entry_t* entry, const char* host)
+{
+    time_t now = time(NULL);
+    for (size_t i = 0; i < TM_SSL_SESSIONS; i++) {
+        ssl_host_session_t* session = &entry->sessions[i];
+        if (session->names == NULL || strcmp(session->names, host) != 0) {
+            continue;
+        }
+        if (now < session->created || now - session->created > TM_SSL_SESSION_EXPIRY) {
+            ssl_session_drop(session);
+            return NULL;
+        }
+
+        // The secret must still be in the context, or a resumed handshake
+        // would fail. axTLS evicts its sessions independently of ours.
+        SSL_CTX* ctx = entry->ctx;
+        for (int j = 0; j < ctx->num_sessions; j++) {
+            if (ctx->ssl_sessions[j] != NULL && memcmp(ctx->ssl_sessions[j]->session_id, session->id, SSL_SESSION_ID_SIZE) == 0) {
+                session->used = ++ssl_ctx_clock;
+                return session;
+            }
+        }
+        ssl_session_drop(session);
+        return NULL;
+    }
+    return NULL;
+}
+
+// Keeps the session ID and certificate names from a full handshake with host.
+static void ssl_session_store (ssl_ctx_entry_t* entry, const char* host, SSL* ssl)
+{
+    int id_len = ssl_get_session_id_size(ssl);
+    if (id_len <= 0 || id_len > SSL_SESSION_ID_SIZE) {
+        return;
+    }
+
+    // Reuse the host's slot, then an empty one, then the least recently used.
+    ssl_host_session_t* session = NULL;
+    for (size_t i = 0; i < TM_SSL_SESSIONS; i++) {
+        ssl_host_session_t* s = &entry->sessions[i];
+        if (s->names != NULL && strcmp(s->names, host) == 0) {
+            session = s;
+            break;
+        }
+        if (session == NULL || (session->names != NULL
+          && (s->names == NULL || (int32_t) (s->used - session->used) < 0))) {
+            session = s;
+        }
+    }
+    ssl_session_drop(session);
+
+    const char* cn = ssl_get_cert_dn(ssl, SSL_X509_CERT_COMMON_NAME);
+    size_t len = strlen(host) + 1 + (cn ? strlen(cn) : 0) + 1;
+    size_t count = 0;
+    const char* altname;
+    while ((altname = ssl_get_cert_subject_alt_dnsname(ssl, count)) != NULL) {
+        len += strlen(altname) + 1;
+        count++;
+    }
+    char* names = malloc(len);
+    if (names == NULL) {
+        return;
+    }
+    char* p = names;
+    for (size_t i = 0; i < count + 2; i++) {
+        const char* name = i == 0 ? host : i == 1 ? (cn ? cn : "") : ssl_get_cert_subject_alt_dnsname(ssl, i - 2);
+        size_t name_len = strlen(name) + 1;
+        memcpy(p, name, name_len);
+        p += name_len;
+    }
+
+    memset(session->id, 0, sizeof(session->id));
+    memcpy(session->id, ssl_get_session_id(ssl), id_len);
+    session->id_len = id_len;
+    session->created = time(NULL);
+    session->used = ++ssl_ctx_clock;
+    session->names = names;
+    session->names_count = 2 + count;
+}
+
+// Certificate name n (0 is the CN, then altnames) kept for a resumed session.
+static const char* ssl_session_name (SSL* ssl, size_t n)
+{
+    ssl_ctx_entry_t* entry = ssl_ctx_entry(ssl->ssl_ctx);
+    if (entry == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < TM_SSL_SESSIONS; i++) {
+        ssl_host_session_t* session = &entry->sessions[i];
+        if (session->names == NULL || session->id_len != ssl->sess_id_size
+          || memcmp(session->id, ssl->session_id, session->id_len) != 0) {
+            continue;
+        }
+        if (n + 1 >= session->names_count) {
+            return NULL;
+        }
+        const char* name = session->names;
+        for (size_t j = 0; j < n + 1; j++) {
+            name += strlen(name) + 1;
+        }
+        return name[0] ? name : NULL;
+    }
+    return NULL;
+}
+
+void tm_ssl_session_stats (uint32_t* hits, uint32_t* misses)
+{
+    *hits = ssl_session_hits;
+    *misses = ssl_session_misses;
+}
+
 int tm_ssl_session_create (tm_ssl_session_t* session, tm_ssl_ctx_t ssl_ctx, tm_socket_t client_fd, const char* host_name)
 {
     int res;
@@ -157,12 +443,28 @@ int tm_ssl_session_create (tm_ssl_session_t* session, tm_ssl_ctx_t ssl_ctx, tm_s
         strncpy((char*) &ssl->host_name, host_name, 255);
     }
 
+    // Offer the last session with this host, as ssl_client_new would.
+    ssl_ctx_entry_t* entry = ssl_ctx_entry(ssl_ctx);
+    ssl_host_session_t* cached = NULL;
+    if (entry != NULL && host_name != NULL) {
+        cached = ssl_session_find(entry, host_name);
+    }
+    if (cached != NULL) {
+        memcpy(ssl->session_id, cached->id, cached->id_len);
+        ssl->sess_id_size = cached->id_len;
+        SET_SSL_FLAG(SSL_SESSION_RESUME);
+    }
+
     SET_SSL_FLAG(SSL_IS_CLIENT);
     res = do_client_connect(ssl);
     if (res != SSL_OK) {
 #ifdef CC3000_DEBUG
         TM_DEBUG("ssl do_connect is bad %d", res);
 #endif
+        if (cached != NULL) {
+            ssl_session_drop(cached);
+        }
+        ssl_free(ssl);
         return res;
     }
     
@@ -176,9 +478,24 @@ int tm_ssl_session_create (tm_ssl_session_t* session, tm_ssl_ctx_t ssl_ctx, tm_s
 #ifdef CC3000_DEBUG
         TM_DEBUG("ssl_handshake_status != SSL_OK, is %d", res);
 #endif
+        if (cached != NULL) {
+            ssl_session_drop(cached);
+        }
+        ssl_free(ssl);
         return res;
     }
 
+    // The server echoes the offered ID if it resumed the session.
+    if (cached != NULL && ssl->sess_id_size == cached->id_len
+      && memcmp(ssl->session_id, cached->id, cached->id_len) == 0) {
+        ssl_session_hits++;
+    } else {
+        ssl_session_misses++;
+        if (entry != NULL && host_name != NULL) {
+            ssl_session_store(entry, host_name, ssl);
+        }
+    }
+
     if (!quiet)
     {
         const char *common_name = ssl_get_cert_dn(ssl,
@@ -209,6 +526,9 @@ int tm_ssl_session_create (tm_ssl_session_t* session, tm_ssl_ctx_t ssl_ctx, tm_s
 int tm_ssl_session_cn (tm_ssl_session_t* session, const char** cn)
 {
     *cn = ssl_get_cert_dn(*session, SSL_X509_CERT_COMMON_NAME);
+    if (*cn == NULL && ((SSL*) *session)->x509_ctx == NULL) {
+        *cn = ssl_session_name(*session, 0);
+    }
     if (*cn == NULL) {
         return 1;
     }
@@ -218,6 +538,9 @@ int tm_ssl_session_cn (tm_ssl_session_t* session, const char** cn)
 int tm_ssl_session_altname (tm_ssl_session_t* session, size_t index, const char** altname)
 {
     *altname = ssl_get_cert_subject_alt_dnsname(*session, index);
+    if (*altname == NULL && ((SSL*) *session)->x509_ctx == NULL) {
+        *altname = ssl_session_name(*session, index + 1);
+    }
     if (*altname == NULL) {
         return 1;
     }
@@ -1,25 +1,11 @@
 #include <assert.h>
+#include <string.h>
 
 #include "tm.h"
 
 uint32_t tm_str_codeat (const uint8_t* buf, size_t buf_len, size_t index)
 {
-	const uint8_t* ptr = buf;
-	uint32_t dst = 0;
-  index += 2;
-	while (index >= 2) {
-		size_t bytes_read = tm_utf8_decode(ptr, buf_len, &dst);
-		assert(dst != TM_UTF8_DECODE_ERROR);      // internal strings should never be malformed
-		ptr += bytes_read;
-		buf_len -= bytes_read;
-		index -= dst & 0x10000 ? 2 : 1;
-	}
-
-	return index == 0
-		? (dst - 0x10000) / 0x400 + 0xD800
-		: dst > 0xFFFF
-			? (dst - 0x10000) % 0x400 + 0xDC00
-			: dst & 0xFFFF;
+  return tm_str_index_codeat(buf, buf_len, NULL, index);
 }
 
 size_t tm_str_fromcode (uint32_t c, uint8_t* buf)
@@ -30,37 +16,180 @@ size_t tm_str_fromcode (uint32_t c, uint8_t* buf)
 // convert UCS-2 index to offset in CESU-8 string
 size_t tm_str_lookup_JsToLua (const uint8_t* buf, size_t len, size_t ucs2_index, size_t* seq_len)
 {
+  return tm_str_index_JsToLua(buf, len, NULL, ucs2_index, seq_len);
+}
+
+
+// convert offset in UTF-8/CESU-8 string to UCS-2 index [converts lengths, really]
+size_t tm_str_lookup_LuaToJs (const uint8_t* buf, size_t len)
+{
+  return tm_str_index_LuaToJs(buf, len, NULL, len);
+}
+
+
+/**
+ * Index of UCS-2 breakpoints, so lookups decode from the nearest mark
+ * instead of from the start of the string.
+ */
+
+// One mark per this many bytes, placed on the next character boundary.
+#define TM_STR_INDEX_STRIDE 64
+
+#define ASCII_HIGH_BITS ((size_t) -1 / 0xFF * 0x80)
+
+size_t tm_str_ascii_prefix (const uint8_t* buf, size_t len)
+{
+  size_t i = 0;
+  // Two words at a time; the high bit of any byte means non-ASCII.
+  for (; i + 2 * sizeof(size_t) <= len; i += 2 * sizeof(size_t)) {
+    size_t words[2];
+    memcpy(words, &buf[i], sizeof(words));
+    if ((words[0] | words[1]) & ASCII_HIGH_BITS) {
+      break;
+    }
+  }
+  for (; i < len; i++) {
+    if (buf[i] & 0x80) {
+      break;
+    }
+  }
+  return i;
+}
+
+int tm_str_is_ascii (const uint8_t* buf, size_t len)
+{
+  return tm_str_ascii_prefix(buf, len) == len;
+}
+
+size_t tm_str_index_size (const uint8_t* buf, size_t len)
+{
+  size_t count = tm_str_is_ascii(buf, len) ? 0 : len / TM_STR_INDEX_STRIDE + 1;
+  return sizeof(tm_str_index_t) + count * sizeof(tm_str_mark_t);
+}
+
+void tm_str_index_build (const uint8_t* buf, size_t len, tm_str_index_t* index)
+{
+  index->ascii = tm_str_is_ascii(buf, len);
+  index->count = 0;
+  if (index->ascii) {
+    index->ucs2_len = len;
+    return;
+  }
+
+  size_t pos = 0, ucs2 = 0, next_mark = 0;
+  while (pos < len) {
+    if (pos >= next_mark) {
+      index->marks[index->count].byte = pos;
+      index->marks[index->count].ucs2 = ucs2;
+      index->count++;
+      next_mark = pos + TM_STR_INDEX_STRIDE;
+    }
+    uint32_t uchar;
+    size_t bytes_read = tm_utf8_decode(&buf[pos], len - pos, &uchar);
+    assert(uchar != TM_UTF8_DECODE_ERROR);      // internal strings should never be malformed
+    if (bytes_read == 0) {
+      break;
+    }
+    pos += bytes_read;
+    ucs2 += (uchar > 0xFFFF) ? 2 : 1;
+  }
+  index->ucs2_len = ucs2;
+}
+
+// Last mark at or before the given position, searching on byte offset
+// (by_ucs2 == 0) or UCS-2 index.
+static const tm_str_mark_t* str_index_mark (const tm_str_index_t* index, size_t pos, int by_ucs2)
+{
+  static const tm_str_mark_t start = { 0, 0 };
+  if (index == NULL || index->count == 0) {
+    return &start;
+  }
+
+  size_t lo = 0, hi = index->count;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    size_t at = by_ucs2 ? index->marks[mid].ucs2 : index->marks[mid].byte;
+    if (at <= pos) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return &index->marks[lo];
+}
+
+size_t tm_str_index_JsToLua (const uint8_t* buf, size_t len, const tm_str_index_t* index, size_t ucs2_index, size_t* seq_len)
+{
+  if (index != NULL && index->ascii) {
+    *seq_len = ucs2_index < len ? 1 : 0;
+    return ucs2_index < len ? ucs2_index : len;
+  }
+
+  const tm_str_mark_t* mark = str_index_mark(index, ucs2_index, 1);
   const uint8_t* const orig_buf = buf;
-  size_t bytes_read;
-  size_t ucs2_position = 0;
-	while (ucs2_position <= ucs2_index) {        // NOTE: we read _past_ ucs2_index to get seq_len
+  size_t bytes_read = 0;
+  size_t ucs2_position = mark->ucs2;
+  buf += mark->byte;
+  len -= mark->byte;
+  while (ucs2_position <= ucs2_index) {        // NOTE: we read _past_ ucs2_index to get seq_len
     if (len == 0) {
       bytes_read = 0;
       break;
     }
     uint32_t uchar;
-		bytes_read = tm_utf8_decode(buf, len, &uchar);
+    bytes_read = tm_utf8_decode(buf, len, &uchar);
     assert(uchar != TM_UTF8_DECODE_ERROR);      // internal strings should never be malformed
     buf += bytes_read;
-		len -= bytes_read;
+    len -= bytes_read;
     ucs2_position += (uchar > 0xFFFF) ? 2 : 1;
-	}
+  }
   *seq_len = bytes_read;
-	return (buf - bytes_read) - orig_buf;
+  return (buf - bytes_read) - orig_buf;
 }
 
-
-// convert offset in UTF-8/CESU-8 string to UCS-2 index [converts lengths, really]
-size_t tm_str_lookup_LuaToJs (const uint8_t* buf, size_t len)
+size_t tm_str_index_LuaToJs (const uint8_t* buf, size_t len, const tm_str_index_t* index, size_t off)
 {
-  size_t ucs2_position = 0;
-	while (len) {
+  if (index != NULL && (index->ascii || off == len)) {
+    return index->ascii ? off : index->ucs2_len;
+  }
+
+  const tm_str_mark_t* mark = str_index_mark(index, off, 0);
+  size_t ucs2_position = mark->ucs2;
+  buf += mark->byte;
+  off -= mark->byte;
+  while (off) {
     uint32_t uchar;
-		size_t bytes_read = tm_utf8_decode(buf, len, &uchar);
+    size_t bytes_read = tm_utf8_decode(buf, off, &uchar);
     assert(uchar != TM_UTF8_DECODE_ERROR);      // internal strings should never be malformed
-		buf += bytes_read;
-		len -= bytes_read;
+    if (bytes_read == 0) {
+      break;
+    }
+    buf += bytes_read;
+    off -= bytes_read;
     ucs2_position += (uchar > 0xFFFF) ? 2 : 1;
-	}
-	return ucs2_position;
+  }
+  return ucs2_position;
+}
+
+uint32_t tm_str_index_codeat (const uint8_t* buf, size_t len, const tm_str_index_t* index, size_t ucs2_index)
+{
+  if (index != NULL && index->ascii) {
+    return ucs2_index < len ? buf[ucs2_index] : TM_UTF8_DECODE_ERROR;
+  }
+
+  size_t seq_len = 0;
+  size_t off = tm_str_index_JsToLua(buf, len, index, ucs2_index, &seq_len);
+  if (seq_len == 0) {
+    return TM_UTF8_DECODE_ERROR;
+  }
+
+  uint32_t dst;
+  tm_utf8_decode(&buf[off], seq_len, &dst);
+  if (dst <= 0xFFFF) {
+    return dst;
+  }
+  // Astral characters span two UCS-2 units; pick the half that was asked for.
+  return tm_str_index_LuaToJs(buf, len, index, off) == ucs2_index
+    ? (dst - 0x10000) / 0x400 + 0xD800
+    : (dst - 0x10000) % 0x400 + 0xDC00;
 }
@@ -20,40 +20,45 @@ tm_event tm_timer_event = TM_EVENT_INIT(timer_cb);
 // Timer ID
 unsigned timer_id = 0;
 
-/// Timers are managed in a sorted linked list of tm_timer entries. Delays are
-/// represented differentially between successive elements. If multiple timers
-/// expire at the same time, the most recently added is placed last.
+// Insertion counter, used to keep timers with equal deadlines in FIFO order.
+unsigned timer_seq = 0;
+
+/// Timers are managed in a binary min-heap ordered by expiry time, and a hash
+/// table indexed by id, so that both scheduling and cancelling are O(log n).
+/// If multiple timers expire at the same time, the most recently added fires
+/// last.
 typedef struct tm_timer {
-  struct tm_timer* next; // Pointer to the timer that happens after this one.
+  struct tm_timer* hash_next; // Next timer in the same id hash bucket
   unsigned id;
-  unsigned time; // Additional delay in microseconds after the previous entry
-  unsigned repeat; // If nonzero, `time` is reset to `repeat` when the timer expires.
+  unsigned time; // Absolute expiry time in microseconds
+  unsigned seq; // Insertion order, for breaking ties on `time`
+  unsigned repeat; // If nonzero, `time` is advanced by `repeat` when the timer expires.
                    // Note that this means setInterval calls are clamped to 1ms
+  size_t slot; // Position in the heap
   int lua_cb; // Callback index in the lua registry
 } tm_timer;
 
-/// Head of the linked list of timers. Pointer to the timeout object which
-/// expires soonest. This linked list structure is managed only by the
-/// callbacks, and is not touched in the ISR.
-tm_timer* timers_head = 0;
+/// The heap. `timers_heap[0]` is the timeout object which expires soonest.
+/// This structure is managed only by the callbacks, and is not touched in
+/// the ISR.
+tm_timer** timers_heap = 0;
+size_t timers_len = 0;
+size_t timers_cap = 0;
+
+/// Hash table of pending timers by id. The bucket count is a power of two;
+/// ids are sequential, so masking them spreads timers evenly.
+tm_timer** timers_buckets = 0;
+size_t timers_bucket_count = 0;
 
 /// The timer count through which we've processed.
 /// It should be safe if this wraps at UINT_MAX as long as all delays are shorter than a timer period.
-/// `last_time + timers_head->time` is the absolute timestamp of the next timeout.
+/// Expiry times are compared relative to `last_time`.
 unsigned last_time = 0;
 
-// Example: The following calls are made in one instant:
-// 	setTimeout(1010, a)
-// 	setTimeout(1000, b)
-// 	setInterval(5000, c)
-// 	setTimeout(1010, d)
-// Makes the linked list look like (time, repeat, cb)
-// 	(1000000, 0, b) -> (10000, 0, a) -> (0, 0, d) -> (3990000, 5000, c)
-
 /// Reconfigure the timer hardware for the next interrupt after the head of
-/// the list has changed.
+/// the heap has changed.
 static void configure_timer_interrupt() {
-	if (timers_head) {
+	if (timers_len) {
 		tm_event_ref(&tm_timer_event);
 	} else {
 		tm_event_unref(&tm_timer_event);
@@ -61,31 +66,128 @@ static void configure_timer_interrupt() {
 	hw_timer_update_interrupt();
 }
 
+/// Returns true if `a` must fire before `b`.
+static bool timer_before(tm_timer* a, tm_timer* b) {
+	unsigned ta = a->time - last_time;
+	unsigned tb = b->time - last_time;
+	if (ta != tb) {
+		return ta < tb;
+	}
+	return (int) (a->seq - b->seq) < 0;
+}
+
+static void heap_place(tm_timer* t, size_t slot) {
+	timers_heap[slot] = t;
+	t->slot = slot;
+}
+
+static void heap_sift_up(size_t slot) {
+	tm_timer* t = timers_heap[slot];
+	while (slot > 0) {
+		size_t parent = (slot - 1) / 2;
+		if (!timer_before(t, timers_heap[parent])) {
+			break;
+		}
+		heap_place(timers_heap[parent], slot);
+		slot = parent;
+	}
+	heap_place(t, slot);
+}
+
+static void heap_sift_down(size_t slot) {
+	tm_timer* t = timers_heap[slot];
+	while (true) {
+		size_t child = slot * 2 + 1;
+		if (child >= timers_len) {
+			break;
+		}
+		if (child + 1 < timers_len && timer_before(timers_heap[child + 1], timers_heap[child])) {
+			child++;
+		}
+		if (!timer_before(timers_heap[child], t)) {
+			break;
+		}
+		heap_place(timers_heap[child], slot);
+		slot = child;
+	}
+	heap_place(t, slot);
+}
+
+static void heap_remove(tm_timer* t) {
+	size_t slot = t->slot;
+	timers_len--;
+	if (slot != timers_len) {
+		// Move the last entry into the hole and restore the heap order.
+		tm_timer* moved = timers_heap[timers_len];
+		heap_place(moved, slot);
+		heap_sift_up(slot);
+		heap_sift_down(moved->slot);
+	}
+	timers_heap[timers_len] = NULL;
+}
+
+static tm_timer** hash_find(unsigned id) {
+	if (timers_bucket_count == 0) {
+		return NULL;
+	}
+	tm_timer** p = &timers_buckets[id & (timers_bucket_count - 1)];
+	while (*p && (*p)->id != id) {
+		p = &(*p)->hash_next;
+	}
+	return p;
+}
+
+static void hash_insert(tm_timer* t) {
+	if (timers_len >= timers_bucket_count) {
+		// Grow the table to keep buckets short, rehashing the existing timers.
+		size_t count = timers_bucket_count ? timers_bucket_count * 2 : 16;
+		tm_timer** buckets = calloc(count, sizeof(tm_timer*));
+		for (size_t i = 0; i < timers_bucket_count; i++) {
+			tm_timer* e = timers_buckets[i];
+			while (e) {
+				tm_timer* next = e->hash_next;
+				e->hash_next = buckets[e->id & (count - 1)];
+				buckets[e->id & (count - 1)] = e;
+				e = next;
+			}
+		}
+		free(timers_buckets);
+		timers_buckets = buckets;
+		timers_bucket_count = count;
+	}
+	tm_timer** bucket = &timers_buckets[t->id & (timers_bucket_count - 1)];
+	t->hash_next = *bucket;
+	*bucket = t;
+}
+
+static void hash_remove(tm_timer* t) {
+	tm_timer** p = hash_find(t->id);
+	if (p && *p) {
+		*p = t->hash_next;
+	}
+	t->hash_next = NULL;
+}
+
 static void destroy_timer(tm_timer* t) {
 	luaL_unref(tm_lua_state, LUA_REGISTRYINDEX, t->lua_cb);
 	free(t);
 }
 
-/// Add a timer to the linked list in the correct position. Returns true if
-/// the head of the queue was modified (meaning you must
+/// Add a timer to the heap, expiring `time` microseconds after `last_time`.
+/// Returns true if the head of the queue was modified (meaning you must
 /// `configure_timer_interrupt()`)
 static bool enqueue_timer(unsigned time, tm_timer* t) {
-	tm_timer** p = &timers_head;
-
-	while (*p) {
-		if (time < (*p)->time) {
-			(*p)->time -= time;
-			break;
-		}
-		time -= (*p)->time;
-		p = &(*p)->next;
+	if (timers_len == timers_cap) {
+		timers_cap = timers_cap ? timers_cap * 2 : 16;
+		timers_heap = realloc(timers_heap, timers_cap * sizeof(tm_timer*));
 	}
 
-	t->time = time;
-	t->next = *p;
-	*p = t;
+	t->time = last_time + time;
+	t->seq = ++timer_seq;
+	heap_place(t, timers_len++);
+	heap_sift_up(t->slot);
 
-	return (p == &timers_head);
+	return t->slot == 0;
 }
 
 /// Create a timer and enqueue it
@@ -93,12 +195,12 @@ unsigned tm_settimeout(unsigned delay, bool repeat, int lua_cb) {
 	tm_timer* t = calloc(sizeof(tm_timer), 1);
 	t->repeat = repeat ? delay : 0;
 	t->lua_cb = lua_cb;
-	t->next = 0;
 	t->id = ++timer_id;
 
 	// Adjust because the times on the queue are relative to last_time
 	unsigned time = delay + (tm_uptime_micro() - last_time);
 
+	hash_insert(t);
 	if (enqueue_timer(time, t)) {
 		configure_timer_interrupt();
 	}
@@ -108,32 +210,29 @@ unsigned tm_settimeout(unsigned delay, bool repeat, int lua_cb) {
 
 /// Cancel and free a timeout by id
 void tm_cleartimeout(unsigned id) {
-	tm_timer** p = &timers_head;
-	while (*p) {
-		tm_timer* t = *p;
-		if (t->id == id) {
-			if (t->next) {
-				t->next->time += t->time;
-			}
-			*p = t->next;
-			destroy_timer(t);
-			break;
-		}
-		p = &t->next;
+	tm_timer** p = hash_find(id);
+	if (p == NULL || *p == NULL) {
+		return;
 	}
 
-	if (p == &timers_head) {
+	tm_timer* t = *p;
+	bool was_head = t->slot == 0;
+	hash_remove(t);
+	heap_remove(t);
+	destroy_timer(t);
+
+	if (was_head) {
 		configure_timer_interrupt();
 	}
 }
 
 bool tm_timer_waiting() {
-	return timers_head != NULL;
+	return timers_len != 0;
 }
 
 unsigned tm_timer_head_time() {
-	if (timers_head != NULL) {
-		return timers_head->time;
+	if (timers_len != 0) {
+		return timers_heap[0]->time - last_time;
 	} else {
 		return 1000000;
 	}
@@ -150,19 +249,18 @@ void timer_cb(tm_event* event) {
 
 	unsigned next_time = tm_uptime_micro();
 
-	while (timers_head) {
-		tm_timer* t = timers_head;
+	while (timers_len) {
+		tm_timer* t = timers_heap[0];
 
 		unsigned remaining = next_time - last_time;
 
-		if (t->time > remaining) {
-			t->time -= remaining;
+		if (t->time - last_time > remaining) {
 			last_time = next_time;
 			break;
 		}
 
-		last_time += t->time;
-		timers_head = t->next;
+		last_time = t->time;
+		heap_remove(t);
 
 		lua_rawgeti(tm_lua_state, LUA_REGISTRYINDEX, t->lua_cb);
 
@@ -171,6 +269,7 @@ void timer_cb(tm_event* event) {
 			enqueue_timer(t->repeat, t);
 		} else {
 			// Clean up before calling lua, as it can setjmp. The callback is safely rooted on the lua stack above.
+			hash_remove(t);
 			destroy_timer(t);
 			t = NULL;
 		}
@@ -184,10 +283,15 @@ void timer_cb(tm_event* event) {
 }
 
 void tm_timer_cleanup() {
-	while (timers_head) {
-		tm_timer* t = timers_head;
-		timers_head = t->next;
+	while (timers_len) {
+		tm_timer* t = timers_heap[--timers_len];
 		destroy_timer(t);
 	}
+	free(timers_heap);
+	timers_heap = NULL;
+	timers_cap = 0;
+	free(timers_buckets);
+	timers_buckets = NULL;
+	timers_bucket_count = 0;
 	tm_event_unref(&tm_timer_event);
 }
@@ -11,6 +11,14 @@ size_t tm_str_to_utf16 (const uint8_t* buf, size_t buf_len, const uint8_t ** con
   
   size_t buf_pos = 0;
   while (buf_pos < buf_len) {
+    if (buf[buf_pos] < 0x80) {
+      // widen ASCII runs without decoding
+      size_t run_end = buf_pos + tm_str_ascii_prefix(buf + buf_pos, buf_len - buf_pos);
+      for (; buf_pos < run_end; buf_pos++) {
+        utf16[utf16_len++] = TM_ENDIAN_SWAP16(endianness, (uint16_t) buf[buf_pos]);
+      }
+      continue;
+    }
     uint32_t uchar;
     buf_pos += tm_utf8_decode(buf + buf_pos, buf_len - buf_pos, &uchar);
     assert(uchar != TM_UTF8_DECODE_ERROR);     // internal strings should never be malformed, 0xFFFD replacement increases length
@@ -26,12 +34,17 @@ size_t tm_str_from_utf16 (const uint8_t* _utf16, size_t _utf16_len, const uint8_
   const uint16_t* utf16 = (const uint16_t*) _utf16;
   size_t utf16_len = _utf16_len >> 1;
   
-  uint8_t* buf = calloc(utf16_len, 3);      // each incoming codepoint could require up to 3 bytes to represent
+  uint8_t* buf = malloc(utf16_len * 3 + 1);      // each incoming codepoint could require up to 3 bytes to represent
   
   size_t buf_pos = 0;
   size_t utf16_pos = 0;
   while (utf16_pos < utf16_len) {
     uint16_t uchar = TM_ENDIAN_SWAP16(endianness, utf16[utf16_pos]);
+    if (uchar < 0x80) {
+      buf[buf_pos++] = uchar;
+      utf16_pos += 1;
+      continue;
+    }
     buf_pos += tm_utf8_encode(buf + buf_pos, 3, uchar);
     utf16_pos += 1;
   }
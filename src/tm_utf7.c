@@ -1,12 +1,19 @@
 #include <assert.h>
+#include <string.h>
 
 #include "tm.h"
 
 size_t _tm_str_to_8bit (const uint8_t* buf, size_t buf_len, const uint8_t ** const dstptr, uint8_t mask) {
+  size_t ascii_len = tm_str_ascii_prefix(buf, buf_len);
+  if (ascii_len == buf_len) {
+    *dstptr = buf;      // ASCII is unchanged by either mask
+    return buf_len;
+  }
+
   uint8_t* ascii_buf = malloc(buf_len);    // NOTE: we know ascii will be this size or less
-  size_t ascii_len = 0;
+  memcpy(ascii_buf, buf, ascii_len);
   
-  size_t buf_pos = 0;
+  size_t buf_pos = ascii_len;
   while (buf_pos < buf_len) {
     uint32_t uchar;
     buf_pos += tm_utf8_decode(buf + buf_pos, buf_len - buf_pos, &uchar);
@@ -24,9 +31,15 @@ size_t tm_str_to_ascii (const uint8_t* buf, size_t buf_len, const uint8_t ** con
 }
 
 size_t tm_str_from_ascii (const uint8_t* ascii_buf, size_t ascii_len, const uint8_t ** const dstptr) {
+  size_t pos = tm_str_ascii_prefix(ascii_buf, ascii_len);
+  if (pos == ascii_len) {
+    *dstptr = ascii_buf;
+    return ascii_len;
+  }
+
   uint8_t* buf = malloc(ascii_len);
+  memcpy(buf, ascii_buf, pos);
   
-  size_t pos = 0;
   while (pos < ascii_len) {
     buf[pos] = ascii_buf[pos] & 0x7F;
     ++pos;
@@ -40,10 +53,16 @@ size_t tm_str_to_binary (const uint8_t* buf, size_t buf_len, const uint8_t ** co
 }
 
 size_t tm_str_from_binary (const uint8_t* binary, size_t binary_len, const uint8_t ** const dstptr) {
-  uint8_t* str = calloc(binary_len, 2);   // NOTE: size could at most double if every incoming byte is > 127
+  size_t binary_pos = tm_str_ascii_prefix(binary, binary_len);
+  if (binary_pos == binary_len) {
+    *dstptr = binary;
+    return binary_len;
+  }
+
+  uint8_t* str = malloc(binary_len * 2);   // NOTE: size could at most double if every incoming byte is > 127
+  memcpy(str, binary, binary_pos);
   
-  size_t str_pos = 0;
-  size_t binary_pos = 0;
+  size_t str_pos = binary_pos;
   while (binary_pos < binary_len) {
     str_pos += tm_utf8_encode(str + str_pos, 2, binary[binary_pos]);
     binary_pos += 1;
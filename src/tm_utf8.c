@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <string.h>
 
 #include "tm.h"
 
@@ -64,12 +65,27 @@ inline size_t tm_utf8_encode(uint8_t* buf, size_t buf_len, uint32_t uc) {
 #define IS_TRAIL(uchar) (uchar > 0xDC00 && uchar <= 0xDFFF)
 
 size_t tm_str_to_utf8 (const uint8_t* buf, size_t buf_len, const uint8_t ** const dstptr) {
+  size_t ascii_len = tm_str_ascii_prefix(buf, buf_len);
+  if (ascii_len == buf_len) {
+    *dstptr = buf;
+    return buf_len;
+  }
+
   uint8_t* utf8 = malloc(buf_len);    // NOTE: we know utf8 always same or shorter
-  size_t utf8_len = 0;
+  memcpy(utf8, buf, ascii_len);
+  size_t utf8_len = ascii_len;
   
   int32_t hchar = 0;    // stores half of surrogate pair
-  size_t buf_pos = 0;
+  size_t buf_pos = ascii_len;
   while (buf_pos < buf_len) {
+    if (!hchar && buf[buf_pos] < 0x80) {
+      // copy ASCII runs as-is
+      size_t run = tm_str_ascii_prefix(buf + buf_pos, buf_len - buf_pos);
+      memcpy(utf8 + utf8_len, buf + buf_pos, run);
+      utf8_len += run;
+      buf_pos += run;
+      continue;
+    }
     uint32_t uchar;
     buf_pos += tm_utf8_decode(buf + buf_pos, buf_len - buf_pos, &uchar);
     assert(uchar != TM_UTF8_DECODE_ERROR);     // internal strings should never be malformed, 0xFFFD replacement increases length
@@ -97,16 +113,31 @@ size_t tm_str_to_utf8 (const uint8_t* buf, size_t buf_len, const uint8_t ** cons
 }
 
 size_t tm_str_from_utf8 (const uint8_t* utf8, size_t utf8_len, const uint8_t ** const dstptr) {
+  size_t ascii_len = tm_str_ascii_prefix(utf8, utf8_len);
+  if (ascii_len == utf8_len) {
+    *dstptr = utf8;
+    return utf8_len;
+  }
+
   size_t buf_len = utf8_len;
   // TODO: increase buf_len to fit actual split pairs (4 bytes become 6) and replaced non-characters (3 bytes per byte in bad sequence)
   buf_len += utf8_len / 2 + 6;    // HACK: this is just a glorified/dynamic fudge factor
   // ugh, test/suite/crypto.js does toString on a 4K buffer of random bytes …PLS TO ADD MOAR FUDGERS!!1!
   buf_len += utf8_len;
   uint8_t* buf = malloc(buf_len);
+  memcpy(buf, utf8, ascii_len);
   
-  size_t buf_pos = 0;
-  size_t utf8_pos = 0;
+  size_t buf_pos = ascii_len;
+  size_t utf8_pos = ascii_len;
   while (utf8_pos < utf8_len) {
+    if (utf8[utf8_pos] < 0x80) {
+      // copy ASCII runs as-is
+      size_t run = tm_str_ascii_prefix(utf8 + utf8_pos, utf8_len - utf8_pos);
+      memcpy(buf + buf_pos, utf8 + utf8_pos, run);
+      buf_pos += run;
+      utf8_pos += run;
+      continue;
+    }
     assert(buf_pos + 6 < buf_len);        // bail if fudge factor was insufficiently generous
     uint32_t uchar;
     size_t bytes_read = tm_utf8_decode(utf8 + utf8_pos, utf8_len - utf8_pos, &uchar);
@@ -0,0 +1,96 @@
+// Copyright 2014 Technical Machine, Inc. See the COPYRIGHT
+// file at the top-level directory of this distribution.
+//
+// Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+// http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+// <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+// option. This file may not be copied, modified, or distributed
+// except according to those terms.
+
+#include <lua.h>
+#include <lauxlib.h>
+#include "tm.h"
+#include "colony.h"
+
+/// A descriptor watched on behalf of lua. `watch` must be the first member so
+/// that the tm_event passed to the callback can be cast back to its owner.
+typedef struct tm_watcher {
+  tm_fd_watch watch;
+  struct tm_watcher* next;
+  int lua_cb; // Callback index in the lua registry
+} tm_watcher;
+
+/// Watchers currently registered with the platform, one per descriptor.
+static tm_watcher* watchers_head = 0;
+
+static void destroy_watcher(tm_watcher* w) {
+	luaL_unref(tm_lua_state, LUA_REGISTRYINDEX, w->lua_cb);
+	// The event queue may still point at us.
+	tm_event_cancel(&w->watch.event);
+	free(w);
+}
+
+static void watcher_cb(tm_event* event) {
+	tm_watcher* w = (tm_watcher*) event;
+
+	lua_rawgeti(tm_lua_state, LUA_REGISTRYINDEX, w->lua_cb);
+	lua_getfield(tm_lua_state, LUA_GLOBALSINDEX, "global");
+	lua_pushnumber(tm_lua_state, w->watch.ready);
+	tm_checked_call(tm_lua_state, 2);
+}
+
+static tm_watcher** find_watcher(tm_socket_t fd) {
+	tm_watcher** p = &watchers_head;
+	while (*p && (*p)->watch.fd != fd) {
+		p = &(*p)->next;
+	}
+	return p;
+}
+
+int tm_watch_start(tm_socket_t fd, unsigned flags, int lua_cb) {
+	tm_watcher** p = find_watcher(fd);
+	tm_watcher* w = *p;
+
+	if (w) {
+		// Replace the callback of the existing watcher.
+		luaL_unref(tm_lua_state, LUA_REGISTRYINDEX, w->lua_cb);
+		w->lua_cb = lua_cb;
+		return tm_fd_register(&w->watch, fd, flags);
+	}
+
+	w = calloc(sizeof(tm_watcher), 1);
+	if (w == NULL) {
+		luaL_unref(tm_lua_state, LUA_REGISTRYINDEX, lua_cb);
+		return -ENOMEM;
+	}
+	w->watch.event.callback = watcher_cb;
+	w->lua_cb = lua_cb;
+
+	int ret = tm_fd_register(&w->watch, fd, flags);
+	if (ret != 0) {
+		destroy_watcher(w);
+		return ret;
+	}
+
+	w->next = watchers_head;
+	watchers_head = w;
+	tm_event_ref(&w->watch.event);
+	return 0;
+}
+
+void tm_watch_stop(tm_socket_t fd) {
+	tm_watcher** p = find_watcher(fd);
+	tm_watcher* w = *p;
+	if (w) {
+		*p = w->next;
+		tm_fd_unregister(&w->watch);
+		tm_event_unref(&w->watch.event);
+		destroy_watcher(w);
+	}
+}
+
+void tm_watch_cleanup() {
+	while (watchers_head) {
+		tm_watch_stop(watchers_head->watch.fd);
+	}
+}
@@ -0,0 +1,15 @@
+// A Buffer used as a prototype serves its bytes and length to derived
+// objects. Node's typed array Buffers reject this, so it is colony-only.
+
+var tap = require('../tap')
+
+tap.count(4)
+
+var base = new Buffer([9, 8, 7])
+var derived = Object.create(base)
+tap.eq(derived[0], 9, 'derived object reads the prototype bytes')
+tap.eq(derived.length, 3, 'derived object reads the prototype length')
+
+var deeper = Object.create(derived)
+tap.eq(deeper[2], 7, 'deeper derived object reads the prototype bytes')
+tap.eq(deeper.length, 3, 'deeper derived object reads the prototype length')
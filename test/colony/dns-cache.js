@@ -0,0 +1,63 @@
+var tap = require('../tap');
+
+tap.count(8);
+
+// Answers come from a stub resolver so that the cache can be checked
+// without a network.
+var tm = process.binding('tm');
+var queries = {};
+tm.dns_lookup = function (domain, callback) {
+  queries[domain] = (queries[domain] || 0) + 1;
+  setImmediate(function () {
+    if (domain == 'missing.test') {
+      callback('ENOTFOUND', [], 0);
+    } else if (domain == 'short.test') {
+      callback(null, [0x0A000001], 0);
+    } else {
+      callback(null, [0x0A000002], 300);
+    }
+  });
+  return 0;
+};
+
+var dns = require('dns');
+
+dns.lookup('cached.test', function (err, address) {
+  tap.ok(!err && address == '10.0.0.2', 'lookup returns the address');
+  dns.lookup('CACHED.test', function (err, address) {
+    tap.ok(address == '10.0.0.2' && queries['CACHED.test'] == null, 'answer is cached for its TTL');
+
+    dns.resolve('missing.test', function (err) {
+      dns.resolve('missing.test', function (err) {
+        tap.ok(err && err.code == 'ENOTFOUND' && queries['missing.test'] == 1, 'missing names are cached');
+
+        dns.lookup('short.test', function () {
+          dns.lookup('short.test', function () {
+            tap.ok(queries['short.test'] == 2, 'answers with no TTL are not cached');
+            sizeBound();
+          });
+        });
+      });
+    });
+  });
+});
+
+var first = 0;
+dns.resolve('shared.test', function () { first++; });
+dns.resolve('shared.test', function () {
+  tap.ok(first == 1 && queries['shared.test'] == 1, 'concurrent lookups share a query');
+});
+
+function sizeBound () {
+  var stats = dns.getCacheStats();
+  tap.ok(stats.hits > 0 && stats.misses > 0, 'hits and misses are counted');
+
+  dns.setCacheOptions({ maxEntries: 1 });
+  tap.ok(dns.getCacheStats().size == 1, 'cache is trimmed to maxEntries');
+
+  dns.clearCache();
+  var before = queries['cached.test'];
+  dns.lookup('cached.test', function () {
+    tap.ok(queries['cached.test'] == before + 1, 'cleared cache queries again');
+  });
+}
@@ -0,0 +1,2 @@
+// Deliberately invalid, and never required at runtime.
+var = ;
@@ -0,0 +1,36 @@
+var tap = require('../tap');
+
+tap.count(5);
+
+var jsonStream = require('json_stream');
+
+function collect (stream, chunks, next) {
+  var values = [];
+  stream.on('data', function (value) {
+    values.push(value);
+  });
+  stream.on('error', function (err) {
+    next(err, values);
+  });
+  stream.on('end', function () {
+    next(null, values);
+  });
+  chunks.forEach(function (chunk) {
+    stream.write(chunk);
+  });
+  stream.end();
+}
+
+collect(jsonStream.parse(), ['{"a":1}\n{"a"', ':2}\n3', '\n"', 'x"\n'], function (err, values) {
+  tap.ok(!err, 'newline-delimited values parse across chunk boundaries');
+  tap.eq(JSON.stringify(values), '[{"a":1},{"a":2},3,"x"]', 'each top-level value is emitted');
+});
+
+collect(jsonStream.parse('rows.*'), [new Buffer('{"count":2,"rows":[{"id":1},'), new Buffer('{"id":2}],"done":true}')], function (err, values) {
+  tap.ok(!err, 'Buffer chunks are accepted');
+  tap.eq(values.map(function (row) { return row.id; }).join(), '1,2', 'path selects array elements');
+});
+
+collect(jsonStream.parse(), ['{"a":[}'], function (err) {
+  tap.ok(err instanceof SyntaxError, 'malformed input emits a SyntaxError');
+});
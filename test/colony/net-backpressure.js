@@ -0,0 +1,37 @@
+var tap = require('../tap');
+
+tap.count(3);
+
+var net = require('net');
+
+var payload = new Buffer(256 * 1024);
+payload.fill(0x61);
+
+var server = net.createServer(function (c) {
+  c.end(payload);
+});
+
+server.listen(0, function () {
+  var client = net.connect(server.address().port);
+  client._readableState.highWaterMark = 1024;
+
+  var tries = 0;
+  setTimeout(function check () {
+    if (!client.__paused && ++tries < 200) {
+      return setTimeout(check, 10);
+    }
+    tap.ok(client.__paused && !client.__watching, 'socket stops reading once push() returns false');
+
+    // Draining the buffer calls _read, which resumes reading.
+    var received = client.read().length;
+    tap.ok(!client.__paused && client.__watching, 'socket reads again on _read');
+
+    client.on('data', function (d) {
+      received += d.length;
+    });
+    client.on('end', function () {
+      tap.ok(received == payload.length, 'all data arrives after resuming');
+      server.close();
+    });
+  }, 10);
+});
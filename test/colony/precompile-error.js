@@ -0,0 +1,12 @@
+var tap = require('../tap');
+
+tap.count(1);
+
+// Both files are compiled in the same batch as this one, since they are
+// static require()s. The broken one must not stop the rest from loading.
+if (false) {
+  require('./fixtures/precompile-broken');
+}
+var ok = require('./fixtures/precompile-ok');
+
+tap.ok(ok == 42, 'a module that fails to compile but is never required does not abort loading');
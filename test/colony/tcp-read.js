@@ -0,0 +1,43 @@
+var tap = require('../tap');
+
+tap.count(6);
+
+// Reads straight from the tm bindings, so nothing else drains the socket.
+var tm = process.binding('tm');
+var net = require('net');
+
+var payload = new Buffer(10000);
+for (var i = 0; i < payload.length; i++) {
+  payload[i] = i & 0xff;
+}
+
+var server = net.createServer(function (c) {
+  c.end(payload);
+});
+
+server.listen(0, function () {
+  var socket = tm.tcp_open();
+  tm.tcp_connect(socket, 0x7f000001, server.address().port);
+
+  // Give the whole payload time to arrive over loopback.
+  setTimeout(function () {
+    var data = tm.tcp_read(socket, 1000)[0];
+    tap.ok(data.length == 1000, 'tcp_read stops at its limit');
+    tap.ok(data[999] == (999 & 0xff), 'tcp_read returns the data in order');
+
+    var buf = new Buffer(64);
+    buf.fill(0);
+    var n = tm.tcp_read_into(socket, buf, 10, 20)[0];
+    tap.ok(n == 20, 'tcp_read_into reads up to its length');
+    tap.ok(buf[9] == 0 && buf[10] == (1000 & 0xff) && buf[29] == (1019 & 0xff) && buf[30] == 0,
+      'tcp_read_into writes at its offset');
+
+    data = tm.tcp_read(socket)[0];
+    tap.ok(data.length == payload.length - 1020, 'one tcp_read drains everything available');
+    tap.ok(data[0] == (1020 & 0xff) && data[data.length - 1] == ((payload.length - 1) & 0xff),
+      'tcp_read returns the rest of the data in order');
+
+    tm.tcp_close(socket);
+    server.close();
+  }, 200);
+});
@@ -1,6 +1,6 @@
 var tap = require('../tap');
 
-tap.count(2);
+tap.count(7);
 
 var dns = require('dns');
 
@@ -8,4 +8,17 @@ dns.resolve('tessel-httpbin.herokuapp.com', function (err, ip) {
 	tap.ok(!err);
 	tap.ok(ip == null || Array.isArray(ip));
 	console.log('#', ip);
-})
\ No newline at end of file
+})
+
+var sync = true;
+dns.lookup('tessel-httpbin.herokuapp.com', function (err, address, family) {
+	tap.ok(!sync, 'lookup calls back asynchronously');
+	tap.ok(!err && /^\d+\.\d+\.\d+\.\d+$/.test(address), 'lookup returns an address');
+	tap.ok(family == 4, 'lookup returns the family');
+})
+sync = false;
+
+dns.resolve('nonexistent.invalid', function (err, ip) {
+	tap.ok(err, 'unknown host is an error');
+	tap.ok(err && err.code == 'ENOTFOUND', 'unknown host is ENOTFOUND');
+})
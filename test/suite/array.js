@@ -1,6 +1,6 @@
 var tap = require('../tap');
 
-tap.count(59);
+tap.count(71);
 
 function arreq (a, b) {
 	if (a.length != b.length) {
@@ -35,9 +35,18 @@ var a = [1, 2, 3];
 a.splice(1, 1);
 tap.ok(arreq(a, [1, 3]), 'splice(1, 1)');
 
+var a = [1, 2, 3, 4, 5];
+var removed = a.splice(1, 2, 'a', 'b', 'c');
+tap.ok(arreq(a, [1, 'a', 'b', 'c', 4, 5]), 'splice inserts more than it removes');
+tap.ok(arreq(removed, [2, 3]), 'splice returns removed elements');
+a.splice(-3, 3);
+tap.ok(arreq(a, [1, 'a', 'b']), 'splice from a negative index');
+
 var a = [2, 3];
 a.unshift(1);
 tap.ok(arreq(a, [1, 2, 3]), 'unshift(1)')
+a.unshift(-1, 0);
+tap.ok(arreq(a, [-1, 0, 1, 2, 3]), 'unshift with several arguments')
 
 var arr = [2];
 tap.ok(arr.length == 1, 'array::unshift - length')
@@ -54,6 +63,16 @@ var arr = [];
 tap.ok(arr.shift() == null, 'array::shift - null values shifted');
 tap.ok(arr.length == 0, 'array::shift - length unmodified when 0');
 
+var queue = [];
+for (var i = 0; i < 1000; i++) {
+  queue.push(i, null);
+}
+var sum = 0;
+while (queue.length) {
+  sum += queue.shift() || 0;
+}
+tap.eq(sum, 499500, 'array::shift - drains a queue with null holes');
+
 tap.ok([0, 0, 0, 0, 0, 0].length == 6);
 tap.ok(arreq([0, 1, 2, 3, 4, 5].slice(0, 5), [0, 1, 2, 3, 4]))
 tap.ok(arreq([0, 0, 0, 0, 0, 0].slice(0, 5), [0, 0, 0, 0, 0]));
@@ -135,6 +154,15 @@ tap.ok(arreq(a, [1,2,3]), 'Array(1,2,3) == [1,2,3]')
 tap.ok([1,2,3].join(',') == '1,2,3');
 tap.ok([1].join(',') == '1');
 tap.ok([null, null, null].join(',') == ',,');
+tap.eq([1, undefined, 'a', {toString: function () { return 'o'; }}].join('-'), '1--a-o', 'join stringifies elements');
+tap.eq([].join(','), '', 'join of empty array');
+var row = [];
+for (var i = 0; i < 10000; i++) {
+  row.push(i % 10);
+}
+var line = row.join(',');
+tap.eq(line.length, 10000 * 2 - 1, 'join of a large array');
+tap.eq('a'.concat('b', 1, null), 'ab1null', 'concat stringifies arguments');
 
 // Array.prototype.forEach applied to String
 var a = [];
@@ -182,6 +210,27 @@ arr.sort(function (a, b) {
 
 tap.eq(arr.join(','), '-11,-6,2,10');
 
+var records = [];
+for (var i = 0; i < 1000; i++) {
+  records.push({ key: i % 7, seq: i });
+}
+records.sort(function (a, b) {
+  return a.key - b.key;
+});
+var stable = true;
+for (var i = 1; i < records.length; i++) {
+  var prev = records[i - 1], cur = records[i];
+  if (prev.key > cur.key || (prev.key == cur.key && prev.seq > cur.seq)) {
+    stable = false;
+  }
+}
+tap.ok(stable, 'sort is stable');
+
+arr = [3, undefined, 1, null, 2];
+arr.sort();
+tap.eq(arr.length, 5, 'sort keeps length');
+tap.eq(arr.join(','), '1,2,3,,', 'sort orders undefined last');
+
 // lastIndexOf
 var array = [2, 5, 9, 2];
 tap.eq(array.lastIndexOf(2), 3, 'lastIndexOf')
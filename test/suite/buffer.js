@@ -1,6 +1,6 @@
 var tap = require('../tap');
 
-tap.count(119);
+tap.count(134);
 
 function arreq (a, b) {
 	if (a.length != b.length) {
@@ -154,6 +154,14 @@ tap.ok(b.toString() == 'hello world', 'base64 encoding (padded)');
 var b = new Buffer('aGVsbG8gd29ybGQ', 'base64');
 tap.ok(b.toString() == 'hello world', 'base64 encoding (not padded)');
 console.log('#', JSON.stringify(b.toString()));
+tap.eq(new Buffer('aGVs\nbG8g d29y\r\nbGQ=', 'base64').toString(), 'hello world', 'base64 ignores whitespace');
+tap.eq(new Buffer('-_-_', 'base64').toString('hex'), 'fbffbf', 'base64 accepts url-safe alphabet');
+tap.eq(new Buffer('hello world').toString('base64', 6, 11), 'd29ybGQ=', 'base64 toString with offsets');
+var big = new Buffer(10000);
+for (var i = 0; i < big.length; i++) {
+  big[i] = i * 7;
+}
+tap.eq(new Buffer(big.toString('base64'), 'base64').toString('hex'), big.toString('hex'), 'base64 round trip of a large buffer');
 
 console.log('\n# encoding')
 tap.ok(new Buffer(new Buffer('hello world').toString('base64'), 'base64').toString() == 'hello world', 'str -> base64 -> str')
@@ -250,3 +258,31 @@ tap.eq(buf[9], 0xFF, "original fill remains");
 
 // inspecting
 tap.ok(require('buffer').INSPECT_MAX_BYTES === 50, 'default INSPECT_MAX_BYTES is 50')
+
+// properties are per-buffer even though buffers share a metatable
+var propA = new Buffer(2), propB = new Buffer(2);
+propA.tag = 'a';
+Object.defineProperty(propA, 'double', { get: function () { return this[0] * 2; } });
+propA[0] = 21;
+tap.eq(propA.tag, 'a', 'custom property set');
+tap.eq(propB.tag, undefined, 'custom property not shared');
+tap.eq(propA.double, 42, 'getter on buffer');
+tap.eq(propB.double, undefined, 'getter not shared');
+tap.eq(propA[0], 21, 'indexing works after defining a getter');
+propA.length = 10;
+tap.eq(propA.length, 2, 'length is read-only');
+
+// slices are views onto the same memory
+var parent = new Buffer([1, 2, 3, 4, 5, 6]);
+var view = parent.slice(1, 5).slice(1, 3);
+tap.eq(view.length, 2, 'slice of a slice has the right length');
+view[0] = 0xAA;
+tap.eq(parent[2], 0xAA, 'writes through a nested slice reach the parent');
+tap.eq(parent.slice(4, 100).length, 2, 'slice end is clamped to the parent');
+
+// bulk construction
+var wrapped = new Buffer([-1, 256, 257, '7']);
+tap.ok(arreq(wrapped.toJSON(), [255, 0, 1, 7]), 'array values wrap into bytes');
+var copied = new Buffer(wrapped);
+copied[0] = 0;
+tap.eq(wrapped[0], 255, 'buffer from buffer copies');
@@ -1,9 +1,11 @@
 var tap = require('../tap');
 
-tap.count(35);
+tap.count(39);
 
 tap.eq(String.fromCharCode(0x1A), '\u001A');
 tap.eq(String.fromCharCode(0x1A), '\x1A');
+tap.eq(String.fromCharCode(0x66, '0x6f', 0x1006f), 'foo', 'fromCharCode joins several code units');
+tap.eq(String.fromCharCode(0xD83D, 0xDE00).length, 2, 'fromCharCode keeps surrogate halves as code units');
 
 // console.log(String.fromCharCode(0x2603) == '☃');
 // console.log(String.fromCharCode(0x2603) == '\u2603');
@@ -59,6 +61,15 @@ tap.eq("\ud83d", poo[0]);
 tap.eq("\udca9", poo[1]);
 tap.eq(0xd83d, poo.charCodeAt(0), poo.charCodeAt(0));
 tap.eq(0xdca9, poo.charCodeAt(1), poo.charCodeAt(1));
+tap.eq('ab'.charCodeAt(NaN), 0x61, 'charCodeAt reads a NaN index as 0');
+
+// Alternating between two large non-ASCII strings reads both correctly.
+var left = new Array(100001).join('\u00e9'), right = new Array(100001).join('\u4e2d');
+var alternated = true;
+for (var i = 0; i < left.length; i += 997) {
+  alternated = alternated && left.charCodeAt(i) == 0xe9 && right.charCodeAt(i) == 0x4e2d;
+}
+tap.ok(alternated, 'charCodeAt alternating between two large strings');
 tap.eq(poo, '\ud83d\udca9');
 tap.ok(poo != '\xd8\x3d\xdc\xa9');
 
@@ -1,7 +1,7 @@
 var tap = require('../tap');
 var buf = require('buffer');
 
-tap.count(75);
+tap.count(87);
 
 // testing vars
 var foo1 = {foundation: "Mozilla", model: "box", week: 45, transport: "car", month: 7};
@@ -115,3 +115,43 @@ var a = { toJSON: function () { return { toJSON: function () { return 5; }}; }}
 tap.eq(JSON.stringify(a), '{}', 'toJSON isnt recursive')
 
 var arr = JSON.parse("[[], {}, [null], [0], [[{}]], \"14121269654077727\"]");
+tap.eq(arr.length, 6, 'nested containers parsed');
+tap.eq(arr[2].length, 1, 'null counts toward array length');
+
+// Top-level primitives and Buffer input
+tap.eq(JSON.parse(' 42 '), 42, 'top-level number');
+tap.eq(JSON.parse('"hi"'), 'hi', 'top-level string');
+tap.eq(JSON.parse(new Buffer('{"a":[1,2,3]}')).a.length, 3, 'parse from a Buffer');
+try {
+  JSON.parse('{"a": }');
+  tap.ok(false, 'invalid JSON throws');
+} catch (e) {
+  tap.ok(e instanceof SyntaxError, 'invalid JSON throws');
+}
+
+// Stringify reentrancy and recovery
+var calls = 0;
+JSON.stringify([1, 2, 3], function (key, value) { calls++; return value; });
+tap.eq(calls, 4, 'replacer called once per value');
+tap.eq(JSON.stringify({ a: { toJSON: function () { return JSON.stringify([1]); } } }), '{"a":"[1]"}', 'stringify inside toJSON');
+try {
+  JSON.stringify({ a: { toJSON: function () { throw new Error('no'); } } });
+} catch (e) { }
+tap.eq(JSON.stringify({ b: [true, null] }), '{"b":[true,null]}', 'stringify after a throwing toJSON');
+
+// Cycles are reported, but shared and deeply nested values are not cycles
+var cyclic = { a: [] };
+cyclic.a.push(cyclic);
+try {
+  JSON.stringify(cyclic);
+  tap.ok(false, 'circular structure throws');
+} catch (e) {
+  tap.ok(/circular/.test(e.message || e), 'circular structure throws');
+}
+var shared = [1];
+tap.eq(JSON.stringify({ a: shared, b: shared }), '{"a":[1],"b":[1]}', 'a value reached twice is not a cycle');
+var deep = [];
+for (var i = 0; i < 300; i++) {
+  deep = [deep];
+}
+tap.eq(JSON.stringify(deep).length, 602, 'deep acyclic nesting is written');
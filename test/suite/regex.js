@@ -1,6 +1,6 @@
 var tap = require('../tap');
 
-tap.count(23);
+tap.count(32);
 
 tap.ok("garbage 09 _ - !@#$%".match(/^[\s\S]+$/), 'regex match');
 
@@ -73,3 +73,46 @@ tap.ok(subj3.replace(/\#(\#*)/g, function (whole, p1, offset, str) {
   // console.log('-->', whole, p1, offset, str);
   return whole.length;
 }) == " 3    2     4  ", 'regex replace with fn');
+
+// Compiled regexes are shared between RegExp objects with the same source.
+var r1 = /a(b)/g, r2 = new RegExp('a(b)', 'g');
+r1.exec('ab ab');
+tap.ok(r1.lastIndex == 2 && r2.lastIndex == 0 && r2.exec('xab')[1] == 'b', 'regexes with the same source keep separate state');
+for (var i = 0; i < 100; i++) {
+  new RegExp('x' + i + 'y');
+}
+tap.ok(/^x(\d+)y$/.exec('x42y')[1] == '42', 'regex compiles after many distinct patterns');
+try {
+  new RegExp('(');
+  tap.ok(false, 'invalid regex throws');
+} catch (e) {
+  tap.ok(e instanceof SyntaxError, 'invalid regex throws');
+}
+
+// Global matches and exec from .lastIndex
+tap.ok('a1b22c333'.match(/\d+/g).join(',') == '1,22,333', 'global match returns every match');
+tap.ok('abc'.match(/\d/g) === null, 'global match without matches is null');
+tap.ok('aaa'.match(/x*/g).length == 4, 'global match advances past empty matches');
+var e = /^a/g;
+e.lastIndex = 1;
+tap.ok(e.exec('aa') === null, '^ does not match after .lastIndex');
+
+// A global exec loop over a large subject, interrupted by a one-shot call
+// on another string halfway through.
+var lines = [];
+for (var i = 0; i < 2000; i++) {
+  lines.push('line ' + i + ' level=' + (i % 3 == 0 ? 'error' : 'info') + ' some padding text here');
+}
+var log = lines.join('\n');
+var levelRe = /level=(\w+)/g, m, errors = 0, seen = 0;
+while ((m = levelRe.exec(log))) {
+  seen++;
+  if (m[1] == 'error') {
+    errors++;
+  }
+  if (seen == 1000) {
+    'a,b'.split(/,/);
+  }
+}
+tap.eq(seen, 2000, 'exec loop over a large subject finds every match');
+tap.eq(errors, 667, 'exec loop over a large subject reads the right captures');
@@ -1,6 +1,6 @@
 var tap = require('../tap')
 
-tap.count(1);
+tap.count(3);
 
 var Readable = require('stream').Readable;
 var Writable = require('stream').Writable;
@@ -28,3 +28,23 @@ C._write = function (chunk, encoding, callback) {
 A.pipe(B).pipe(C).on('finish', function () {
 	tap.ok(true, 'stream piping ended with end event')
 });
+
+// Queued chunks come out in order, whether whole, split or unshifted.
+var queued = new Readable({ objectMode: true });
+queued._read = function () {};
+for (var i = 0; i < 1000; i++) {
+  queued.push(i);
+}
+var inOrder = true;
+for (var i = 0; i < 1000; i++) {
+  inOrder = inOrder && queued.read() === i;
+}
+tap.ok(inOrder, 'object chunks are read in the order they were pushed');
+
+var bytes = new Readable();
+bytes._read = function () {};
+bytes.push(new Buffer('cd'));
+bytes.push(new Buffer('efg'));
+bytes.unshift(new Buffer('ab'));
+var parts = [bytes.read(1), bytes.read(2), bytes.read(4)].join('|');
+tap.eq(parts, 'a|bc|defg', 'reads split, join and unshift queued chunks');
@@ -1,6 +1,6 @@
 var tap = require('../tap');
 
-tap.count(61);
+tap.count(65);
 
 tap.ok("1234567890".substring(3, 6) == "456", 'substring 1')
 tap.ok("abc".substring(0, 0) == "", 'substring 2')
@@ -70,6 +70,19 @@ tap.eq(s.charAt(6), '✇');
 tap.eq(s[s.length], undefined);
 tap.eq(s.charAt(s.length), '');
 
+var long = '';
+for (var i = 0; i < 200; i++) {
+  long += s;
+}
+tap.eq(long.length, 200 * s.length, 'length of a long non-ASCII string');
+var codes = 0;
+for (var i = 0; i < long.length; i++) {
+  codes += long.charCodeAt(i) == s.charCodeAt(i % s.length) ? 1 : 0;
+}
+tap.eq(codes, long.length, 'charCodeAt across a long non-ASCII string');
+tap.eq(long.slice(1503, 1505), s.slice(3, 5), 'slice deep into a long non-ASCII string');
+tap.ok(isNaN(s.charCodeAt(s.length)), 'charCodeAt past the end is NaN');
+
 tap.eq("aBc\0123".toUpperCase(), 'ABC\0123');
 tap.eq("aBc\0123".toLowerCase(), 'abc\0123');
 
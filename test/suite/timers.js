@@ -1,6 +1,6 @@
 var tap = require('../tap');
 
-tap.count(4);
+tap.count(8);
 
 var source = setTimeout(function () {
   // TODO this test differs between Node and browser.
@@ -30,4 +30,43 @@ setImmediate(function (arg1, arg2, arg3) {
 	tap.ok(arg1 != null, 'args passed into callback');
 	tap.ok(arg2 == null, 'null args allowed in callback');
 	tap.ok(arg3 != null, 'null args allowed in callback');
-}, 5, null, 6)
\ No newline at end of file
+}, 5, null, 6)
+
+var order = [];
+setImmediate(function () {
+	order.push('immediate');
+	process.nextTick(function () {
+		order.push('tick in immediate');
+	});
+});
+var cleared = setImmediate(function () {
+	order.push('cleared');
+});
+clearImmediate(cleared);
+setImmediate(function () {
+	tap.ok(order.join() == 'tick,immediate,tick in immediate', 'ticks run before immediates: ' + order.join());
+	tap.ok(order.indexOf('cleared') == -1, 'clearImmediate cancels an immediate');
+});
+process.nextTick(function () {
+	order.push('tick');
+});
+
+// Timers with equal deadlines fire in the order they were set.
+var fired = [];
+for (var i = 0; i < 5; i++) {
+	setTimeout(fired.push.bind(fired, i), 20);
+}
+setTimeout(function () {
+	tap.ok(fired.join() == '0,1,2,3,4', 'equal deadlines fire in insertion order: ' + fired.join());
+}, 20);
+
+// Clearing a timer deep in the queue leaves the others intact.
+var late = [];
+setTimeout(function () { late.push('a'); }, 30);
+var middle = setTimeout(function () { late.push('b'); }, 40);
+setTimeout(function () { late.push('c'); }, 50);
+setTimeout(function () { late.push('d'); }, 60);
+clearTimeout(middle);
+setTimeout(function () {
+	tap.ok(late.join() == 'a,c,d', 'clearTimeout cancels a timer that is not next to fire: ' + late.join());
+}, 70);
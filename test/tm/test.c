@@ -1,4 +1,5 @@
 #include "tm.h"
+#include "tm_json.h"
 #include "greatest-buf.h"
 
 inline void print_buffer (uint8_t* buf, size_t len) {
@@ -227,11 +228,140 @@ TEST unicode_case ()
 	PASS();
 }
 
+TEST unicode_ascii_passthrough ()
+{
+	const uint8_t* ascii = (const uint8_t*) "plain ascii needs no transcoding";
+	size_t ascii_len = strlen((const char*) ascii);
+	const uint8_t* out = NULL;
+
+	ASSERT_EQm("utf8 passthrough", tm_str_to_utf8(ascii, ascii_len, &out), ascii_len);
+	ASSERT_EQm("utf8 passthrough", out, ascii);
+	ASSERT_EQm("utf8 passthrough", tm_str_from_utf8(ascii, ascii_len, &out), ascii_len);
+	ASSERT_EQm("utf8 passthrough", out, ascii);
+
+	size_t poo_len = strlen((const char*) pileofpoo);
+	ASSERT_EQm("ascii prefix", tm_str_ascii_prefix(pileofpoo, poo_len), 1);
+	ASSERT_EQm("utf8 transcodes", tm_str_from_utf8(pileofpoo, poo_len, &out), poo_len + 2);
+	ASSERT_FALSEm("utf8 transcodes", out == pileofpoo);
+	free((uint8_t*) out);
+
+	PASS();
+}
 
 SUITE(unicode)
 {
 	RUN_TEST(unicode_ucs2);
 	RUN_TEST(unicode_case);
+	RUN_TEST(unicode_ascii_passthrough);
+}
+
+/**
+ * base64
+ */
+
+TEST base64_roundtrip ()
+{
+	const char* cases[][2] = {
+		{ "", "" },
+		{ "f", "Zg==" },
+		{ "fo", "Zm8=" },
+		{ "foo", "Zm9v" },
+		{ "foob", "Zm9vYg==" },
+		{ "fooba", "Zm9vYmE=" },
+		{ "foobar", "Zm9vYmFy" },
+	};
+
+	for (int i = 0; i < (int) (sizeof(cases) / sizeof(cases[0])); i++) {
+		const char* raw = cases[i][0];
+		const char* enc = cases[i][1];
+		char out[16] = {0};
+		uint8_t dec[16] = {0};
+
+		ASSERT_EQm("base64 encode length", tm_base64_encode_length(strlen(raw)), strlen(enc));
+		ASSERT_EQm("base64 encode", tm_base64_encode((const uint8_t*) raw, strlen(raw), out), strlen(enc));
+		ASSERT_STR_EQm("base64 encode", enc, out);
+
+		ASSERT_EQm("base64 decode length", tm_base64_decode_length(enc, strlen(enc)), strlen(raw));
+		ASSERT_EQm("base64 decode", tm_base64_decode(enc, strlen(enc), dec), strlen(raw));
+		ASSERT_STR_EQm("base64 decode", raw, (char*) dec);
+	}
+
+	PASS();
+}
+
+TEST base64_lenient ()
+{
+	const char* enc = " Zm9v\r\nYm\tFy-_";
+	uint8_t dec[16] = {0};
+	size_t len = tm_base64_decode_length(enc, strlen(enc));
+	ASSERT_EQm("base64 skips whitespace", len, 7);
+	ASSERT_EQm("base64 skips whitespace", tm_base64_decode(enc, strlen(enc), dec), len);
+	ASSERT_EQm("base64 urlsafe", dec[6], 0xfb);
+	ASSERT_EQm("base64 stops at padding", tm_base64_decode_length("Zg==Zm9v", 8), 1);
+	ASSERT_EQm("base64 skips invalid", tm_base64_decode_length("\xe8\x86\x82", 3), 0);
+
+	const char* wrapped = "Zm9vYmFy\nZm9vY\nmFyZm9v";
+	uint8_t line_dec[16] = {0};
+	ASSERT_EQm("base64 decodes wrapped lines", tm_base64_decode(wrapped, strlen(wrapped), line_dec), 15);
+	ASSERT_STR_EQm("base64 decodes wrapped lines", "foobarfoobarfoo", (char*) line_dec);
+
+	PASS();
+}
+
+SUITE(base64)
+{
+	RUN_TEST(base64_roundtrip);
+	RUN_TEST(base64_lenient);
+}
+
+/**
+ * json stream
+ */
+
+static char json_stream_out[256];
+
+static int json_stream_collect (void* state, const char* value, size_t len)
+{
+	(void) state;
+	strncat(json_stream_out, value, len);
+	strcat(json_stream_out, "|");
+	return 0;
+}
+
+TEST json_stream_chunks ()
+{
+	const char* input = "{\"rows\":[{\"a\":\"]\"},[1,2],3],\"n\":{\"rows\":[4]}}";
+	size_t len = strlen(input);
+	tm_json_stream_t s;
+
+	// Feed one byte at a time, so every value spans chunks.
+	ASSERT_EQ(tm_json_stream_init(&s, "rows.*", 6), 0);
+	json_stream_out[0] = 0;
+	for (size_t i = 0; i < len; i++) {
+		ASSERT_EQ(tm_json_stream_write(&s, &input[i], 1, json_stream_collect, NULL), 0);
+	}
+	ASSERT_EQ(tm_json_stream_end(&s, json_stream_collect, NULL), 0);
+	ASSERT_STR_EQm("json stream selects path", json_stream_out, "{\"a\":\"]\"}|[1,2]|3|");
+	tm_json_stream_free(&s);
+
+	// Newline-delimited values, including a trailing number.
+	ASSERT_EQ(tm_json_stream_init(&s, "", 0), 0);
+	json_stream_out[0] = 0;
+	ASSERT_EQ(tm_json_stream_write(&s, "{}\n\"a\"\n1", 8, json_stream_collect, NULL), 0);
+	ASSERT_EQ(tm_json_stream_end(&s, json_stream_collect, NULL), 0);
+	ASSERT_STR_EQm("json stream top-level values", json_stream_out, "{}|\"a\"|1|");
+	tm_json_stream_free(&s);
+
+	ASSERT_EQ(tm_json_stream_init(&s, "", 0), 0);
+	ASSERT_EQm("json stream mismatched bracket", tm_json_stream_write(&s, "[}", 2, json_stream_collect, NULL), TM_JSON_STREAM_ESYNTAX);
+	tm_json_stream_free(&s);
+
+	PASS();
+}
+
+SUITE(json_stream)
+{
+	RUN_TEST(json_stream_chunks);
 }
 
 /**
@@ -246,5 +376,7 @@ int main(int argc, char **argv)
 	// RUN_SUITE(tm_buf);
 	// RUN_SUITE(runtime);
 	RUN_SUITE(unicode);
+	RUN_SUITE(base64);
+	RUN_SUITE(json_stream);
 	GREATEST_MAIN_END();        /* display results */
 }